@@ -0,0 +1,112 @@
+#include "allocation.h"
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace allocation {
+
+namespace {
+
+constexpr std::size_t kHugePage = std::size_t{2} << 20;
+
+std::atomic<Placement> placement{Placement::kLazy};
+std::atomic<std::size_t> large_threshold{std::size_t{32} << 20};
+
+std::size_t MappedBytes(std::size_t bytes) {
+  return (bytes + kHugePage - 1) / kHugePage * kHugePage;
+}
+
+#if defined(__linux__)
+
+// Maps bytes (a multiple of kHugePage) at a huge page aligned address, so the
+// whole range is eligible for transparent huge pages
+void* MapAligned(std::size_t bytes) {
+  std::size_t padded = bytes + kHugePage;
+  void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) return nullptr;
+  auto start = reinterpret_cast<std::uintptr_t>(raw);
+  std::uintptr_t aligned = (start + kHugePage - 1) / kHugePage * kHugePage;
+  if (aligned > start) munmap(raw, aligned - start);
+  std::size_t tail = start + padded - (aligned + bytes);
+  if (tail > 0) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+  return reinterpret_cast<void*>(aligned);
+}
+
+void Interleave(void* data, std::size_t bytes) {
+  // Interleave over the nodes this process may use; without NUMA support
+  // the calls fail and the default local policy stays
+  unsigned long nodes[16] = {0};
+  const unsigned long max_node = sizeof(nodes) * 8;
+  if (syscall(SYS_get_mempolicy, nullptr, nodes, max_node, nullptr,
+              MPOL_F_MEMS_ALLOWED) != 0)
+    return;
+  syscall(SYS_mbind, data, bytes, MPOL_INTERLEAVE, nodes, max_node, 0);
+}
+
+double* Map(int rows, int cols) {
+  std::size_t bytes =
+      MappedBytes(static_cast<std::size_t>(rows) * cols * sizeof(double));
+  void* data = MapAligned(bytes);
+  if (data == nullptr) return nullptr;
+  madvise(data, bytes, MADV_HUGEPAGE);
+  if (GetPlacement() == Placement::kInterleave) Interleave(data, bytes);
+  return static_cast<double*>(data);
+}
+
+#else
+
+double* Map(int, int) { return nullptr; }
+
+#endif
+
+}  // namespace
+
+Placement GetPlacement() noexcept { return placement.load(); }
+
+void SetPlacement(Placement mode) noexcept { placement.store(mode); }
+
+std::size_t LargeThreshold() noexcept { return large_threshold.load(); }
+
+void SetLargeThreshold(std::size_t bytes) noexcept {
+  large_threshold.store(bytes);
+}
+
+double* Allocate(int rows, int cols, bool* mapped) {
+  *mapped = false;
+  std::size_t count = static_cast<std::size_t>(rows) * cols;
+  if (count == 0) return nullptr;
+  if (count * sizeof(double) >= LargeThreshold()) {
+    double* data = Map(rows, cols);
+    if (data != nullptr) {
+      *mapped = true;
+      return data;
+    }
+  }
+  return new double[count]{};
+}
+
+void Release(double* data, int rows, int cols, bool mapped) noexcept {
+  if (data == nullptr) return;
+#if defined(__linux__)
+  if (mapped) {
+    std::size_t count = static_cast<std::size_t>(rows) * cols;
+    munmap(data, MappedBytes(count * sizeof(double)));
+    return;
+  }
+#else
+  (void)rows;
+  (void)cols;
+  (void)mapped;
+#endif
+  delete[] data;
+}
+
+}  // namespace allocation
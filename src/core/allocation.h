@@ -0,0 +1,35 @@
+#ifndef SRC_CORE_ALLOCATION_H_
+#define SRC_CORE_ALLOCATION_H_
+
+#include <cstddef>
+
+// Storage for matrix elements. Small matrices come from the heap; large ones
+// get their own anonymous mapping, which the kernel hands out already zeroed,
+// aligned and advised for 2 MB transparent huge pages so that big kernels do
+// not thrash the TLB.
+namespace allocation {
+
+// Where the pages of a large matrix are placed on NUMA machines
+enum class Placement {
+  // Pages appear wherever they are first written (the default); nothing
+  // touches them at allocation
+  kLazy,
+  // Pages are spread round-robin over all allowed nodes
+  kInterleave
+};
+
+Placement GetPlacement() noexcept;
+void SetPlacement(Placement placement) noexcept;
+
+// Matrices of at least this many bytes are mapped directly (32 MB default)
+std::size_t LargeThreshold() noexcept;
+void SetLargeThreshold(std::size_t bytes) noexcept;
+
+// Returns zeroed storage for rows * cols elements, or nullptr when that is
+// zero. Sets *mapped to tell Release how the storage was obtained.
+double* Allocate(int rows, int cols, bool* mapped);
+void Release(double* data, int rows, int cols, bool mapped) noexcept;
+
+}  // namespace allocation
+
+#endif  // SRC_CORE_ALLOCATION_H_
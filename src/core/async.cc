@@ -0,0 +1,51 @@
+#include "async.h"
+
+#include "factorization.h"
+#include "parallel.h"
+
+AsyncResult<Matrix> SumMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right) {
+  return RunAsync(
+      ThreadPool::Default(),
+      [](const Matrix& a, const Matrix& b) { return a + b; }, left, right);
+}
+
+AsyncResult<Matrix> SubMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right) {
+  return RunAsync(
+      ThreadPool::Default(),
+      [](const Matrix& a, const Matrix& b) { return a - b; }, left, right);
+}
+
+AsyncResult<Matrix> MulNumberAsync(AsyncResult<Matrix> matrix, double num) {
+  return matrix.Then([num](const Matrix& a) { return a * num; });
+}
+
+AsyncResult<Matrix> MulMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right) {
+  return RunAsync(
+      ThreadPool::Default(),
+      [](const Matrix& a, const Matrix& b) { return Matrix(a * b); }, left,
+      right);
+}
+
+AsyncResult<Matrix> TransposeAsync(AsyncResult<Matrix> matrix) {
+  return matrix.Then([](const Matrix& a) { return a.Transpose(); });
+}
+
+AsyncResult<double> DeterminantAsync(AsyncResult<Matrix> matrix) {
+  return matrix.Then([](const Matrix& a) { return a.Determinant(); });
+}
+
+AsyncResult<Matrix> InverseAsync(AsyncResult<Matrix> matrix) {
+  return matrix.Then([](const Matrix& a) { return a.InverseMatrix(); });
+}
+
+AsyncResult<Matrix> SolveAsync(AsyncResult<Matrix> a, AsyncResult<Matrix> b) {
+  return RunAsync(
+      ThreadPool::Default(),
+      [](const Matrix& lhs, const Matrix& rhs) {
+        return LUFactorization(lhs).Solve(rhs);
+      },
+      a, b);
+}
@@ -0,0 +1,177 @@
+#ifndef SRC_CORE_ASYNC_H_
+#define SRC_CORE_ASYNC_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_oop.h"
+#include "parallel.h"
+
+// Thrown by AsyncResult::Get for operations cancelled before they started,
+// and for everything that depends on them
+class OperationCancelled : public std::runtime_error {
+ public:
+  OperationCancelled() : std::runtime_error("Operation was cancelled") {}
+};
+
+template <class T>
+class AsyncResult;
+
+namespace async_detail {
+
+template <class T>
+struct State {
+  std::mutex mutex;
+  std::condition_variable ready_cv;
+  bool ready = false;
+  std::optional<T> value;
+  std::exception_ptr error;
+  std::vector<std::function<void()>> continuations;
+  std::atomic<bool> cancelled{false};
+
+  void Finish(std::optional<T>&& result, std::exception_ptr failure) {
+    std::vector<std::function<void()>> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      value = std::move(result);
+      error = failure;
+      ready = true;
+      pending.swap(continuations);
+    }
+    ready_cv.notify_all();
+    for (auto& continuation : pending) continuation();
+  }
+
+  // Runs callback once the state is ready, immediately if it already is
+  void OnReady(std::function<void()> callback) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!ready) {
+        continuations.push_back(std::move(callback));
+        return;
+      }
+    }
+    callback();
+  }
+};
+
+}  // namespace async_detail
+
+// Handle to the result of an operation running on a ThreadPool, similar to
+// std::shared_future. Handles are cheap to copy and can be passed as inputs
+// to further asynchronous operations, which then start as soon as all their
+// inputs are ready, so a graph of operations runs with as much overlap as
+// the dependencies allow.
+template <class T>
+class AsyncResult {
+ private:
+  std::shared_ptr<async_detail::State<T>> state_;
+
+  explicit AsyncResult(std::shared_ptr<async_detail::State<T>> state)
+      : state_(std::move(state)) {}
+
+  template <class U>
+  friend class AsyncResult;
+  template <class F, class... Args>
+  friend auto RunAsync(ThreadPool& pool, F function,
+                       AsyncResult<Args>... inputs)
+      -> AsyncResult<std::invoke_result_t<F, const Args&...>>;
+
+ public:
+  // Wraps a value that is already available
+  AsyncResult(T value) : state_(std::make_shared<async_detail::State<T>>()) {
+    state_->Finish(std::move(value), nullptr);
+  }
+
+  bool IsReady() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->ready;
+  }
+
+  void Wait() const {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->ready_cv.wait(lock, [this] { return state_->ready; });
+  }
+
+  // Waits for the result and returns it, rethrowing the operation's error
+  const T& Get() const {
+    Wait();
+    if (state_->error) std::rethrow_exception(state_->error);
+    return *state_->value;
+  }
+
+  // Requests cancellation. An operation that has not started yet finishes
+  // with OperationCancelled instead of running; one already running
+  // completes normally.
+  void Cancel() { state_->cancelled.store(true); }
+
+  // Schedules function(result) to run once this result is ready
+  template <class F>
+  auto Then(F function, ThreadPool& pool = ThreadPool::Default()) const {
+    return RunAsync(pool, std::move(function), *this);
+  }
+};
+
+// Runs function(inputs.Get()...) on the pool once every input is ready. If
+// an input failed or was cancelled the error is passed on without running.
+template <class F, class... Args>
+auto RunAsync(ThreadPool& pool, F function, AsyncResult<Args>... inputs)
+    -> AsyncResult<std::invoke_result_t<F, const Args&...>> {
+  using R = std::invoke_result_t<F, const Args&...>;
+  auto state = std::make_shared<async_detail::State<R>>();
+  auto remaining = std::make_shared<std::atomic<int>>(sizeof...(Args) + 1);
+  auto launch = [&pool, state, function = std::move(function),
+                 inputs...]() mutable {
+    pool.Submit([state, function = std::move(function), inputs...]() mutable {
+      if (state->cancelled.load()) {
+        state->Finish(std::nullopt,
+                      std::make_exception_ptr(OperationCancelled()));
+        return;
+      }
+      try {
+        state->Finish(function(inputs.Get()...), nullptr);
+      } catch (...) {
+        state->Finish(std::nullopt, std::current_exception());
+      }
+    });
+  };
+  auto arrive = std::make_shared<std::function<void()>>(
+      [remaining, launch = std::move(launch)]() mutable {
+        if (remaining->fetch_sub(1) == 1) launch();
+      });
+  (inputs.state_->OnReady([arrive] { (*arrive)(); }), ...);
+  (*arrive)();
+  return AsyncResult<R>(state);
+}
+
+template <class F>
+auto RunAsync(F function) {
+  return RunAsync(ThreadPool::Default(), std::move(function));
+}
+
+// Asynchronous counterparts of the Matrix operations. Matrix arguments
+// convert to ready results; move large operands in to avoid a copy.
+
+AsyncResult<Matrix> SumMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right);
+AsyncResult<Matrix> SubMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right);
+AsyncResult<Matrix> MulNumberAsync(AsyncResult<Matrix> matrix, double num);
+AsyncResult<Matrix> MulMatrixAsync(AsyncResult<Matrix> left,
+                                   AsyncResult<Matrix> right);
+AsyncResult<Matrix> TransposeAsync(AsyncResult<Matrix> matrix);
+AsyncResult<double> DeterminantAsync(AsyncResult<Matrix> matrix);
+AsyncResult<Matrix> InverseAsync(AsyncResult<Matrix> matrix);
+// Solves A * X = B
+AsyncResult<Matrix> SolveAsync(AsyncResult<Matrix> a, AsyncResult<Matrix> b);
+
+#endif  // SRC_CORE_ASYNC_H_
@@ -0,0 +1,268 @@
+#include "factorization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "kernels.h"
+#include "profiler.h"
+
+namespace {
+
+Matrix Identity(int size) {
+  Matrix result(size, size);
+  for (int i = 0; i < size; i++) result(i, i) = 1;
+  return result;
+}
+
+}  // namespace
+
+LUFactorization::LUFactorization(const Matrix& matrix)
+    : lu_(matrix), sign_(1), regular_(true), invertible_(true) {
+  ProfileScope scope("LUFactorization", lu_.rows_, lu_.cols_);
+  if (matrix.rows_ != matrix.cols_)
+    throw std::out_of_range("The matrix isn't square!");
+  regular_ = kernels::LuFactor(lu_.rows_, kernels::MakeView(lu_.matrix_),
+                               &pivots_, &sign_);
+  for (int i = 0; i < lu_.rows_; i++)
+    invertible_ = invertible_ && lu_.matrix_[i][i] != 0;
+}
+
+int LUFactorization::GetSize() const noexcept { return lu_.rows_; }
+
+bool LUFactorization::IsSingular() const noexcept { return !regular_; }
+
+Matrix LUFactorization::Solve(const Matrix& b) const {
+  ProfileScope scope("LUFactorization::Solve", b.rows_, b.cols_);
+  if (b.rows_ != lu_.rows_)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  if (!invertible_)
+    throw std::invalid_argument("Incorrect input, matrix determinant is zero");
+  Matrix result(b);
+  kernels::LuSolve(lu_.rows_, result.cols_, kernels::MakeView(lu_.matrix_),
+                   pivots_, kernels::MakeView(result.matrix_));
+  return result;
+}
+
+double LUFactorization::Determinant() const noexcept {
+  double result = sign_;
+  for (int i = 0; i < lu_.rows_; i++) result *= lu_.matrix_[i][i];
+  return result;
+}
+
+Matrix LUFactorization::Inverse() const { return Solve(Identity(GetSize())); }
+
+CholeskyFactorization::CholeskyFactorization(const Matrix& matrix)
+    : l_(matrix) {
+  ProfileScope scope("CholeskyFactorization", l_.rows_, l_.cols_);
+  if (matrix.rows_ != matrix.cols_)
+    throw std::out_of_range("The matrix isn't square!");
+  for (int i = 0; i < l_.rows_; i++)
+    for (int j = 0; j < i; j++)
+      if (fabs(l_.matrix_[i][j] - l_.matrix_[j][i]) > 1e-7)
+        throw std::invalid_argument("Incorrect input, matrix isn't symmetric");
+  if (!kernels::CholeskyFactor(l_.rows_, kernels::MakeView(l_.matrix_)))
+    throw std::invalid_argument(
+        "Incorrect input, matrix isn't positive definite");
+  for (int i = 0; i < l_.rows_; i++)
+    for (int j = i + 1; j < l_.cols_; j++) l_.matrix_[i][j] = 0;
+}
+
+int CholeskyFactorization::GetSize() const noexcept { return l_.rows_; }
+
+Matrix CholeskyFactorization::GetL() const { return l_; }
+
+Matrix CholeskyFactorization::Solve(const Matrix& b) const {
+  ProfileScope scope("CholeskyFactorization::Solve", b.rows_, b.cols_);
+  if (b.rows_ != l_.rows_)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  Matrix result(b);
+  auto l = kernels::MakeView(l_.matrix_);
+  auto x = kernels::MakeView(result.matrix_);
+  kernels::TrsmLower(l_.rows_, result.cols_, l, x);
+  kernels::TrsmLowerTransposed(l_.rows_, result.cols_, l, x);
+  return result;
+}
+
+double CholeskyFactorization::Determinant() const noexcept {
+  double result = 1;
+  for (int i = 0; i < l_.rows_; i++) result *= l_.matrix_[i][i];
+  return result * result;
+}
+
+Matrix CholeskyFactorization::Inverse() const {
+  return Solve(Identity(GetSize()));
+}
+
+QRFactorization::QRFactorization(const Matrix& matrix) : qr_(matrix) {
+  ProfileScope scope("QRFactorization", qr_.rows_, qr_.cols_);
+  if (matrix.rows_ < matrix.cols_)
+    throw std::invalid_argument(
+        "Incorrect input, matrix has more columns than rows");
+  kernels::QrFactor(qr_.rows_, qr_.cols_, kernels::MakeView(qr_.matrix_),
+                    &tau_);
+}
+
+int QRFactorization::GetRows() const noexcept { return qr_.rows_; }
+
+int QRFactorization::GetCols() const noexcept { return qr_.cols_; }
+
+Matrix QRFactorization::GetR() const {
+  Matrix result(qr_.cols_, qr_.cols_);
+  for (int i = 0; i < qr_.cols_; i++)
+    for (int j = i; j < qr_.cols_; j++) result.matrix_[i][j] = qr_.matrix_[i][j];
+  return result;
+}
+
+Matrix QRFactorization::Solve(const Matrix& b) const {
+  if (qr_.rows_ != qr_.cols_)
+    throw std::out_of_range("The matrix isn't square!");
+  return LeastSquares(b);
+}
+
+Matrix QRFactorization::LeastSquares(const Matrix& b) const {
+  ProfileScope scope("QRFactorization::LeastSquares", b.rows_, b.cols_);
+  if (b.rows_ != qr_.rows_)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  int n = qr_.cols_;
+  double scale = 0;
+  for (int i = 0; i < n; i++) scale = std::max(scale, fabs(qr_.matrix_[i][i]));
+  double tolerance = qr_.rows_ * std::numeric_limits<double>::epsilon() * scale;
+  for (int i = 0; i < n; i++)
+    if (fabs(qr_.matrix_[i][i]) <= tolerance)
+      throw std::invalid_argument("Incorrect input, matrix is rank deficient");
+  Matrix work(b);
+  auto qr = kernels::MakeView(qr_.matrix_);
+  auto x = kernels::MakeView(work.matrix_);
+  kernels::QrApplyTransposed(qr_.rows_, n, work.cols_, qr, tau_, x);
+  kernels::TrsmUpper(n, work.cols_, qr, x);
+  Matrix result(n, b.cols_);
+  result.CopyMatrix(work);
+  return result;
+}
+
+double QRFactorization::Determinant() const {
+  if (qr_.rows_ != qr_.cols_)
+    throw std::out_of_range("The matrix isn't square!");
+  double result = 1;
+  for (int i = 0; i < qr_.cols_; i++) {
+    result *= qr_.matrix_[i][i];
+    // Every non-trivial reflector has determinant -1
+    if (tau_[i] != 0) result = -result;
+  }
+  return result;
+}
+
+Matrix QRFactorization::Inverse() const { return Solve(Identity(GetCols())); }
+
+MixedPrecisionSolver::MixedPrecisionSolver(const Matrix& matrix)
+    : a_(matrix), max_iterations_(30) {
+  ProfileScope scope("MixedPrecisionSolver", a_.rows_, a_.cols_);
+  if (matrix.rows_ != matrix.cols_)
+    throw std::out_of_range("The matrix isn't square!");
+  int n = a_.rows_;
+  lu_data_.resize(static_cast<std::size_t>(n) * n);
+  lu_rows_.resize(n);
+  bool finite = true;
+  for (int i = 0; i < n; i++) {
+    lu_rows_[i] = lu_data_.data() + static_cast<std::size_t>(i) * n;
+    for (int j = 0; j < n; j++) {
+      lu_rows_[i][j] = static_cast<float>(a_.matrix_[i][j]);
+      finite = finite && std::isfinite(lu_rows_[i][j]);
+    }
+  }
+  int sign = 1;
+  if (!finite || !kernels::LuFactor(n, kernels::MakeView(lu_rows_.data()),
+                                    &pivots_, &sign))
+    FallBack();
+}
+
+int MixedPrecisionSolver::GetSize() const noexcept { return a_.rows_; }
+
+bool MixedPrecisionSolver::UsesFallback() const noexcept {
+  return fallback_ != nullptr;
+}
+
+void MixedPrecisionSolver::SetMaxIterations(int iterations) {
+  if (iterations <= 0)
+    throw std::invalid_argument("Iteration count must be positive");
+  max_iterations_ = iterations;
+}
+
+void MixedPrecisionSolver::FallBack() {
+  fallback_ = std::make_unique<LUFactorization>(a_);
+  lu_data_.clear();
+  lu_rows_.clear();
+}
+
+Matrix MixedPrecisionSolver::Solve(const Matrix& b, RefinementStats* stats) {
+  ProfileScope scope("MixedPrecisionSolver::Solve", b.rows_, b.cols_);
+  if (b.rows_ != a_.rows_)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  RefinementStats local;
+  RefinementStats& result_stats = stats ? *stats : local;
+  result_stats = RefinementStats();
+  int n = a_.rows_, nrhs = b.cols_;
+  double a_norm = 0;
+  for (int i = 0; i < n; i++) {
+    double row = 0;
+    for (int j = 0; j < n; j++) row += fabs(a_.matrix_[i][j]);
+    a_norm = std::max(a_norm, row);
+  }
+  // LAPACK's dsgesv stopping rule: ||r|| < ||x|| * ||A|| * eps * sqrt(n)
+  double target = std::numeric_limits<double>::epsilon() * std::sqrt(n);
+
+  Matrix x(n, nrhs), r;
+  // Sets r = B - A * X and returns the worst relative residual
+  auto measure = [&]() {
+    r = b;
+    kernels::Gemm(n, nrhs, n, -1.0, kernels::MakeView(a_.matrix_),
+                  kernels::MakeView(x.matrix_), kernels::MakeView(r.matrix_));
+    double worst = 0;
+    for (int j = 0; j < nrhs; j++) {
+      double r_norm = 0, x_norm = 0;
+      for (int i = 0; i < n; i++) {
+        r_norm = std::max(r_norm, fabs(r.matrix_[i][j]));
+        x_norm = std::max(x_norm, fabs(x.matrix_[i][j]));
+      }
+      double scale = a_norm * x_norm;
+      double relative = scale > 0 ? r_norm / scale : r_norm;
+      if (std::isnan(relative)) relative = std::numeric_limits<double>::max();
+      worst = std::max(worst, relative);
+    }
+    return worst;
+  };
+
+  std::vector<float> d_data(static_cast<std::size_t>(n) * nrhs);
+  std::vector<float*> d_rows(n);
+  for (int i = 0; i < n; i++)
+    d_rows[i] = d_data.data() + static_cast<std::size_t>(i) * nrhs;
+  auto d = kernels::MakeView(d_rows.data());
+  double previous = std::numeric_limits<double>::infinity();
+  if (!fallback_) measure();
+  while (!fallback_ && result_stats.iterations < max_iterations_) {
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < nrhs; j++)
+        d_rows[i][j] = static_cast<float>(r.matrix_[i][j]);
+    kernels::LuSolve(n, nrhs, kernels::MakeView(lu_rows_.data()), pivots_, d);
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < nrhs; j++) x.matrix_[i][j] += d_rows[i][j];
+    result_stats.iterations++;
+    double worst = result_stats.residual = measure();
+    if (worst <= target) {
+      result_stats.converged = true;
+      return x;
+    }
+    // Each step should gain roughly the float precision; if it no longer
+    // halves the residual the system is too ill-conditioned for refinement
+    if (worst > 0.5 * previous) break;
+    previous = worst;
+  }
+  if (!fallback_) FallBack();
+  result_stats.fell_back = true;
+  x = fallback_->Solve(b);
+  result_stats.residual = measure();
+  result_stats.converged = result_stats.residual <= target;
+  return x;
+}
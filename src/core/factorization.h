@@ -0,0 +1,110 @@
+#ifndef SRC_CORE_FACTORIZATION_H_
+#define SRC_CORE_FACTORIZATION_H_
+
+#include <memory>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Factorizations are computed once in the constructor, after which every
+// solve against a new right-hand side costs O(n^2) per column.
+
+// LU decomposition with partial pivoting of a square matrix: P * A = L * U
+class LUFactorization {
+ private:
+  Matrix lu_;
+  std::vector<int> pivots_;
+  int sign_;
+  bool regular_;
+  bool invertible_;
+
+ public:
+  explicit LUFactorization(const Matrix& matrix);
+
+  int GetSize() const noexcept;
+  // Checks whether the matrix is numerically singular: some pivot is no
+  // larger than n * epsilon times the largest entry of its column
+  bool IsSingular() const noexcept;
+  // Solves A * X = B for every column of B; throws only if a pivot is
+  // exactly zero
+  Matrix Solve(const Matrix& b) const;
+  // Returns the determinant, the signed product of the pivots
+  double Determinant() const noexcept;
+  // Calculates and returns the inverse matrix
+  Matrix Inverse() const;
+};
+
+// Cholesky decomposition of a symmetric positive definite matrix: A = L * L^T
+class CholeskyFactorization {
+ private:
+  Matrix l_;
+
+ public:
+  explicit CholeskyFactorization(const Matrix& matrix);
+
+  int GetSize() const noexcept;
+  // Returns the lower triangular factor L
+  Matrix GetL() const;
+  // Solves A * X = B for every column of B
+  Matrix Solve(const Matrix& b) const;
+  double Determinant() const noexcept;
+  Matrix Inverse() const;
+};
+
+// Householder QR decomposition of a matrix with at least as many rows as
+// columns: A = Q * R
+class QRFactorization {
+ private:
+  Matrix qr_;
+  std::vector<double> tau_;
+
+ public:
+  explicit QRFactorization(const Matrix& matrix);
+
+  int GetRows() const noexcept;
+  int GetCols() const noexcept;
+  // Returns the upper triangular factor R (cols x cols)
+  Matrix GetR() const;
+  // Solves A * X = B for a square matrix
+  Matrix Solve(const Matrix& b) const;
+  // Finds X minimizing ||A * X - B|| for every column of B
+  Matrix LeastSquares(const Matrix& b) const;
+  double Determinant() const;
+  Matrix Inverse() const;
+};
+
+// Outcome of a MixedPrecisionSolver::Solve call
+struct RefinementStats {
+  int iterations = 0;      // Refinement steps performed in double precision
+  double residual = 0;     // max ||B - A * X|| / (||A|| * ||X||) over columns
+  bool converged = false;  // Residual reached double precision accuracy
+  bool fell_back = false;  // Solved by the double precision LU instead
+};
+
+// Solves square systems to double precision with a single precision LU.
+// The float factorization costs half the memory traffic of the double one
+// and the residual is refined in double until it stops improving. Systems
+// too ill-conditioned for that switch to LUFactorization for good.
+class MixedPrecisionSolver {
+ private:
+  Matrix a_;
+  std::vector<float> lu_data_;
+  std::vector<float*> lu_rows_;
+  std::vector<int> pivots_;
+  std::unique_ptr<LUFactorization> fallback_;
+  int max_iterations_;
+
+  void FallBack();
+
+ public:
+  explicit MixedPrecisionSolver(const Matrix& matrix);
+
+  int GetSize() const noexcept;
+  // Checks whether the solver already switched to double precision
+  bool UsesFallback() const noexcept;
+  void SetMaxIterations(int iterations);
+  // Solves A * X = B for every column of B
+  Matrix Solve(const Matrix& b, RefinementStats* stats = nullptr);
+};
+
+#endif  // SRC_CORE_FACTORIZATION_H_
@@ -0,0 +1,415 @@
+#ifndef SRC_CORE_KERNELS_H_
+#define SRC_CORE_KERNELS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+// Dense building blocks shared by Matrix and the factorizations. They work on
+// row pointer arrays, the storage Matrix uses, and are templates so the same
+// code runs in single and double precision.
+namespace kernels {
+
+// Panel width of the blocked factorizations
+constexpr int kPanel = 64;
+// Cache blocking of the inner product dimension and of the output columns
+constexpr int kBlockK = 128;
+constexpr int kBlockN = 256;
+
+// A rectangular window into row pointer storage, starting at (row, col)
+template <class T>
+struct View {
+  T* const* rows;
+  int row, col;
+
+  T* operator[](int i) const { return rows[row + i] + col; }
+  View Sub(int r, int c) const { return {rows, row + r, col + c}; }
+};
+
+template <class T>
+View<T> MakeView(T* const* rows) {
+  return {rows, 0, 0};
+}
+
+// C(m x n) += alpha * A(m x k) * B(k x n). Rows of C are split across threads
+// and the k and n dimensions are blocked so the active part of B stays in
+// cache while it is reused by every row.
+template <class T>
+void Gemm(int m, int n, int k, T alpha, View<const T> a, View<const T> b,
+          View<T> c) {
+  if (m <= 0 || n <= 0 || k <= 0) return;
+  std::size_t row_work = static_cast<std::size_t>(n) * k;
+  parallel::For(m, row_work, [&](int begin, int end) {
+    for (int kk = 0; kk < k; kk += kBlockK) {
+      int k_end = std::min(kk + kBlockK, k);
+      for (int jj = 0; jj < n; jj += kBlockN) {
+        int j_end = std::min(jj + kBlockN, n);
+        for (int i = begin; i < end; i++) {
+          const T* a_row = a[i];
+          T* c_row = c[i];
+          for (int p = kk; p < k_end; p++) {
+            T scale = alpha * a_row[p];
+            if (scale == T(0)) continue;
+            const T* b_row = b[p];
+            for (int j = jj; j < j_end; j++) c_row[j] += scale * b_row[j];
+          }
+        }
+      }
+    }
+  });
+}
+
+template <class T>
+void Gemm(int m, int n, int k, T alpha, View<T> a, View<T> b, View<T> c) {
+  Gemm<T>(m, n, k, alpha, View<const T>{a.rows, a.row, a.col},
+          View<const T>{b.rows, b.row, b.col}, c);
+}
+
+// B(n x nrhs) = L^-1 * B for unit lower triangular L
+template <class T>
+void TrsmLowerUnit(int n, int nrhs, View<T> l, View<T> b) {
+  for (int i = 0; i < n; i++) {
+    T* b_row = b[i];
+    for (int p = 0; p < i; p++) {
+      T scale = l[i][p];
+      if (scale == T(0)) continue;
+      const T* src = b[p];
+      for (int j = 0; j < nrhs; j++) b_row[j] -= scale * src[j];
+    }
+  }
+}
+
+// B(n x nrhs) = U^-1 * B for upper triangular U
+template <class T>
+void TrsmUpper(int n, int nrhs, View<T> u, View<T> b) {
+  for (int i = n - 1; i >= 0; i--) {
+    T* b_row = b[i];
+    for (int p = i + 1; p < n; p++) {
+      T scale = u[i][p];
+      if (scale == T(0)) continue;
+      const T* src = b[p];
+      for (int j = 0; j < nrhs; j++) b_row[j] -= scale * src[j];
+    }
+    T diagonal = u[i][i];
+    for (int j = 0; j < nrhs; j++) b_row[j] /= diagonal;
+  }
+}
+
+// B(n x nrhs) = L^-1 * B for non-unit lower triangular L
+template <class T>
+void TrsmLower(int n, int nrhs, View<T> l, View<T> b) {
+  for (int i = 0; i < n; i++) {
+    T* b_row = b[i];
+    for (int p = 0; p < i; p++) {
+      T scale = l[i][p];
+      if (scale == T(0)) continue;
+      const T* src = b[p];
+      for (int j = 0; j < nrhs; j++) b_row[j] -= scale * src[j];
+    }
+    T diagonal = l[i][i];
+    for (int j = 0; j < nrhs; j++) b_row[j] /= diagonal;
+  }
+}
+
+// B(n x nrhs) = L^-T * B for non-unit lower triangular L. Walks L by rows,
+// scattering each solved row into the ones above it.
+template <class T>
+void TrsmLowerTransposed(int n, int nrhs, View<T> l, View<T> b) {
+  for (int i = n - 1; i >= 0; i--) {
+    T* b_row = b[i];
+    T diagonal = l[i][i];
+    for (int j = 0; j < nrhs; j++) b_row[j] /= diagonal;
+    for (int p = 0; p < i; p++) {
+      T scale = l[i][p];
+      if (scale == T(0)) continue;
+      T* dst = b[p];
+      for (int j = 0; j < nrhs; j++) dst[j] -= scale * b_row[j];
+    }
+  }
+}
+
+// Blocked right-looking LU with partial pivoting, in place: A = P * L * U.
+// pivots[j] is the row swapped with row j at step j. Only an exactly zero
+// pivot stops the elimination of its column. Returns false if some pivot is
+// no larger than n * epsilon * max|A(:, j)|, the largest entry of the same
+// column of the input, so that badly scaled but regular columns still count
+// as regular.
+template <class T>
+bool LuFactor(int n, View<T> a, std::vector<int>* pivots, int* sign) {
+  pivots->assign(n, 0);
+  *sign = 1;
+  bool regular = true;
+  std::vector<T> tolerance(n, T(0));
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      tolerance[j] = std::max(tolerance[j], std::fabs(a[i][j]));
+  for (T& value : tolerance) value *= n * std::numeric_limits<T>::epsilon();
+  for (int k0 = 0; k0 < n; k0 += kPanel) {
+    int kb = std::min(kPanel, n - k0);
+    for (int j = k0; j < k0 + kb; j++) {
+      int pivot = j;
+      for (int i = j + 1; i < n; i++)
+        if (std::fabs(a[i][j]) > std::fabs(a[pivot][j])) pivot = i;
+      (*pivots)[j] = pivot;
+      if (pivot != j) {
+        std::swap_ranges(a[j], a[j] + n, a[pivot]);
+        *sign = -*sign;
+      }
+      T diagonal = a[j][j];
+      if (std::fabs(diagonal) <= tolerance[j]) regular = false;
+      if (diagonal == T(0)) continue;
+      for (int i = j + 1; i < n; i++) {
+        T* row = a[i];
+        T factor = row[j] /= diagonal;
+        if (factor == T(0)) continue;
+        const T* pivot_row = a[j];
+        for (int c = j + 1; c < k0 + kb; c++) row[c] -= factor * pivot_row[c];
+      }
+    }
+    int rest = n - k0 - kb;
+    if (rest > 0) {
+      TrsmLowerUnit(kb, rest, a.Sub(k0, k0), a.Sub(k0, k0 + kb));
+      Gemm<T>(rest, rest, kb, T(-1), a.Sub(k0 + kb, k0), a.Sub(k0, k0 + kb),
+              a.Sub(k0 + kb, k0 + kb));
+    }
+  }
+  return regular;
+}
+
+// Solves A * X = B in place given the output of LuFactor
+template <class T>
+void LuSolve(int n, int nrhs, View<T> lu, const std::vector<int>& pivots,
+             View<T> b) {
+  for (int j = 0; j < n; j++)
+    if (pivots[j] != j) std::swap_ranges(b[j], b[j] + nrhs, b[pivots[j]]);
+  TrsmLowerUnit(n, nrhs, lu, b);
+  TrsmUpper(n, nrhs, lu, b);
+}
+
+// Blocked Cholesky, in place on the lower triangle: A = L * L^T. The upper
+// triangle is never read. Returns false if A is not positive definite.
+template <class T>
+bool CholeskyFactor(int n, View<T> a) {
+  for (int k0 = 0; k0 < n; k0 += kPanel) {
+    int kb = std::min(kPanel, n - k0);
+    for (int j = k0; j < k0 + kb; j++) {
+      T* row_j = a[j];
+      T diagonal = row_j[j];
+      for (int p = k0; p < j; p++) diagonal -= row_j[p] * row_j[p];
+      if (!(diagonal > T(0))) return false;
+      diagonal = std::sqrt(diagonal);
+      row_j[j] = diagonal;
+      for (int i = j + 1; i < k0 + kb; i++) {
+        T* row_i = a[i];
+        T value = row_i[j];
+        for (int p = k0; p < j; p++) value -= row_i[p] * row_j[p];
+        row_i[j] = value / diagonal;
+      }
+    }
+    int rest = n - k0 - kb;
+    if (rest <= 0) continue;
+    // L21 = A21 * L11^-T, one row at a time
+    View<T> l11 = a.Sub(k0, k0), a21 = a.Sub(k0 + kb, k0);
+    parallel::For(rest, static_cast<std::size_t>(kb) * kb, [&](int b, int e) {
+      for (int i = b; i < e; i++) {
+        T* row = a21[i];
+        for (int j = 0; j < kb; j++) {
+          T value = row[j];
+          for (int p = 0; p < j; p++) value -= row[p] * l11[j][p];
+          row[j] = value / l11[j][j];
+        }
+      }
+    });
+    // A22 -= L21 * L21^T on the lower triangle only
+    View<T> a22 = a.Sub(k0 + kb, k0 + kb);
+    parallel::For(rest, static_cast<std::size_t>(rest) * kb / 2,
+                  [&](int b, int e) {
+                    for (int i = b; i < e; i++) {
+                      const T* l_i = a21[i];
+                      T* row = a22[i];
+                      for (int j = 0; j <= i; j++) {
+                        const T* l_j = a21[j];
+                        T dot = 0;
+                        for (int p = 0; p < kb; p++) dot += l_i[p] * l_j[p];
+                        row[j] -= dot;
+                      }
+                    }
+                  });
+  }
+  return true;
+}
+
+// Builds the Householder reflector H = I - tau * v * v^T that maps column j
+// of A below the diagonal onto a multiple of e_1. v is stored under the
+// diagonal with an implicit leading one, beta replaces A[j][j].
+template <class T>
+T Householder(int m, int j, View<T> a) {
+  T alpha = a[j][j], sigma = 0;
+  for (int i = j + 1; i < m; i++) sigma += a[i][j] * a[i][j];
+  if (sigma == T(0)) return T(0);
+  T beta = std::sqrt(alpha * alpha + sigma);
+  if (alpha > T(0)) beta = -beta;
+  T tau = (beta - alpha) / beta;
+  T scale = T(1) / (alpha - beta);
+  for (int i = j + 1; i < m; i++) a[i][j] *= scale;
+  a[j][j] = beta;
+  return tau;
+}
+
+// Blocked Householder QR of an m x n matrix (m >= n), in place. Each panel is
+// factored column by column, then its reflectors are accumulated into the
+// compact WY form I - V * T * V^T and applied to the trailing columns with
+// two matrix products.
+template <class T>
+void QrFactor(int m, int n, View<T> a, std::vector<T>* tau) {
+  tau->assign(n, T(0));
+  std::vector<T> w;
+  for (int k0 = 0; k0 < n; k0 += kPanel) {
+    int kb = std::min(kPanel, n - k0);
+    for (int j = k0; j < k0 + kb; j++) {
+      T t = (*tau)[j] = Householder(m, j, a);
+      if (t == T(0)) continue;
+      // Apply H to the remaining panel columns: w = v^T * A, A -= tau * v * w
+      int width = k0 + kb - j - 1;
+      if (width <= 0) continue;
+      w.assign(width, T(0));
+      for (int i = j; i < m; i++) {
+        T v = i == j ? T(1) : a[i][j];
+        const T* row = a[i] + j + 1;
+        for (int c = 0; c < width; c++) w[c] += v * row[c];
+      }
+      for (int i = j; i < m; i++) {
+        T v = (i == j ? T(1) : a[i][j]) * t;
+        T* row = a[i] + j + 1;
+        for (int c = 0; c < width; c++) row[c] -= v * w[c];
+      }
+    }
+    int rest = n - k0 - kb, height = m - k0;
+    if (rest <= 0) continue;
+    // Explicit V (height x kb) and V^T (kb x height)
+    std::vector<T> v_data(static_cast<std::size_t>(height) * kb, T(0));
+    std::vector<T> vt_data(static_cast<std::size_t>(kb) * height, T(0));
+    std::vector<T*> v_rows(height), vt_rows(kb);
+    for (int i = 0; i < height; i++) v_rows[i] = v_data.data() + i * kb;
+    for (int c = 0; c < kb; c++) vt_rows[c] = vt_data.data() + c * height;
+    for (int i = 0; i < height; i++)
+      for (int c = 0; c < kb && c <= i; c++) {
+        T v = c == i ? T(1) : a[k0 + i][k0 + c];
+        v_rows[i][c] = vt_rows[c][i] = v;
+      }
+    // Upper triangular T with Q = I - V * T * V^T
+    std::vector<T> t_data(static_cast<std::size_t>(kb) * kb, T(0));
+    auto t_at = [&](int r, int c) -> T& { return t_data[r * kb + c]; };
+    for (int c = 0; c < kb; c++) {
+      T t = (*tau)[k0 + c];
+      t_at(c, c) = t;
+      if (t == T(0)) continue;
+      std::vector<T> z(c, T(0));
+      for (int r = 0; r < c; r++) {
+        T dot = 0;
+        for (int i = c; i < height; i++) dot += vt_rows[r][i] * vt_rows[c][i];
+        z[r] = -t * dot;
+      }
+      for (int r = 0; r < c; r++) {
+        T value = 0;
+        for (int p = r; p < c; p++) value += t_at(r, p) * z[p];
+        t_at(r, c) = value;
+      }
+    }
+    // A2 -= V * (T^T * (V^T * A2))
+    std::vector<T> w_data(static_cast<std::size_t>(kb) * rest, T(0));
+    std::vector<T> u_data(static_cast<std::size_t>(kb) * rest, T(0));
+    std::vector<T*> w_rows(kb), u_rows(kb);
+    for (int c = 0; c < kb; c++) {
+      w_rows[c] = w_data.data() + c * rest;
+      u_rows[c] = u_data.data() + c * rest;
+    }
+    View<T> a2 = a.Sub(k0, k0 + kb);
+    Gemm<T>(kb, rest, height, T(1), MakeView<T>(vt_rows.data()), a2,
+            MakeView<T>(w_rows.data()));
+    for (int r = 0; r < kb; r++)
+      for (int p = 0; p <= r; p++) {
+        T scale = t_at(p, r);
+        if (scale == T(0)) continue;
+        for (int c = 0; c < rest; c++) u_rows[r][c] += scale * w_rows[p][c];
+      }
+    Gemm<T>(height, rest, kb, T(-1), MakeView<T>(v_rows.data()),
+            MakeView<T>(u_rows.data()), a2);
+  }
+}
+
+// B(m x nrhs) = Q^T * B given the output of QrFactor
+template <class T>
+void QrApplyTransposed(int m, int n, int nrhs, View<T> qr,
+                       const std::vector<T>& tau, View<T> b) {
+  std::vector<T> w(nrhs);
+  for (int j = 0; j < n; j++) {
+    T t = tau[j];
+    if (t == T(0)) continue;
+    std::fill(w.begin(), w.end(), T(0));
+    for (int i = j; i < m; i++) {
+      T v = i == j ? T(1) : qr[i][j];
+      const T* row = b[i];
+      for (int c = 0; c < nrhs; c++) w[c] += v * row[c];
+    }
+    for (int i = j; i < m; i++) {
+      T v = (i == j ? T(1) : qr[i][j]) * t;
+      T* row = b[i];
+      for (int c = 0; c < nrhs; c++) row[c] -= v * w[c];
+    }
+  }
+}
+
+// Cyclic Jacobi eigenvalue algorithm for a symmetric n x n matrix. A is
+// overwritten, ending with the eigenvalues on its diagonal; V receives the
+// eigenvectors as columns, so that A = V * diag(A) * V^T on entry.
+template <class T>
+void SymmetricEigen(int n, View<T> a, View<T> v) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) v[i][j] = i == j ? T(1) : T(0);
+  const int kMaxSweeps = 50;
+  for (int sweep = 0; sweep < kMaxSweeps; sweep++) {
+    T off = 0, total = 0;
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) {
+        T square = a[i][j] * a[i][j];
+        total += square;
+        if (i != j) off += square;
+      }
+    T epsilon = std::numeric_limits<T>::epsilon();
+    if (off <= epsilon * epsilon * total) return;
+    for (int p = 0; p < n - 1; p++) {
+      for (int q = p + 1; q < n; q++) {
+        T apq = a[p][q];
+        if (apq == T(0)) continue;
+        T theta = (a[q][q] - a[p][p]) / (2 * apq);
+        T t = T(1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+        if (theta < 0) t = -t;
+        T c = T(1) / std::sqrt(t * t + 1), s = t * c;
+        for (int k = 0; k < n; k++) {
+          if (k == p || k == q) continue;
+          T akp = a[k][p], akq = a[k][q];
+          a[k][p] = a[p][k] = c * akp - s * akq;
+          a[k][q] = a[q][k] = s * akp + c * akq;
+        }
+        a[p][p] -= t * apq;
+        a[q][q] += t * apq;
+        a[p][q] = a[q][p] = 0;
+        for (int k = 0; k < n; k++) {
+          T vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c * vkp - s * vkq;
+          v[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace kernels
+
+#endif  // SRC_CORE_KERNELS_H_
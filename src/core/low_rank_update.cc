@@ -0,0 +1,119 @@
+#include "low_rank_update.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "factorization.h"
+
+namespace {
+
+Matrix Identity(int size) {
+  Matrix result(size, size);
+  for (int i = 0; i < size; i++) result(i, i) = 1;
+  return result;
+}
+
+double NormInf(const Matrix& matrix) {
+  double result = 0;
+  for (int i = 0; i < matrix.GetRows(); i++) {
+    double row = 0;
+    for (int j = 0; j < matrix.GetCols(); j++) row += fabs(matrix(i, j));
+    result = std::max(result, row);
+  }
+  return result;
+}
+
+}  // namespace
+
+IncrementalInverse::IncrementalInverse(const Matrix& matrix)
+    : determinant_(0), max_growth_(1e8), refactorizations_(0) {
+  Refactorize(Matrix(matrix));
+  refactorizations_ = 0;
+}
+
+IncrementalInverse::IncrementalInverse(const Matrix& matrix,
+                                       const Matrix& inverse,
+                                       double determinant)
+    : a_(matrix),
+      inverse_(inverse),
+      determinant_(determinant),
+      max_growth_(1e8),
+      refactorizations_(0) {
+  if (matrix.GetRows() != matrix.GetCols())
+    throw std::out_of_range("The matrix isn't square!");
+  if (inverse.GetRows() != matrix.GetRows() ||
+      inverse.GetCols() != matrix.GetCols())
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+}
+
+const Matrix& IncrementalInverse::GetMatrix() const noexcept { return a_; }
+
+const Matrix& IncrementalInverse::GetInverse() const noexcept {
+  return inverse_;
+}
+
+double IncrementalInverse::Determinant() const noexcept {
+  return determinant_;
+}
+
+int IncrementalInverse::GetRefactorizations() const noexcept {
+  return refactorizations_;
+}
+
+void IncrementalInverse::SetMaxGrowth(double growth) {
+  if (!(growth >= 1))
+    throw std::invalid_argument("Growth limit must be at least one");
+  max_growth_ = growth;
+}
+
+void IncrementalInverse::Refactorize(Matrix&& matrix) {
+  LUFactorization lu(matrix);
+  inverse_ = lu.Inverse();
+  determinant_ = lu.Determinant();
+  a_ = std::move(matrix);
+  refactorizations_++;
+}
+
+void IncrementalInverse::Update(const Matrix& u, const Matrix& v) {
+  int n = a_.GetRows(), k = u.GetCols();
+  if (u.GetRows() != n || v.GetRows() != n || v.GetCols() != k)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  Matrix v_t = v.Transpose();
+  Matrix updated = a_ + u * v_t;
+  // A'^-1 = A^-1 - Z * C^-1 * W with Z = A^-1 * U, W = V^T * A^-1 and the
+  // capacitance matrix C = I + V^T * Z; det(A') = det(C) * det(A)
+  Matrix z = inverse_ * u;
+  Matrix w = v_t * inverse_;
+  Matrix projected = v_t * z;
+  LUFactorization lu(Identity(k) + projected);
+  if (lu.IsSingular()) {
+    Refactorize(std::move(updated));
+    return;
+  }
+  Matrix capacitance_inverse = lu.Inverse();
+  double growth = (1 + NormInf(projected)) * NormInf(capacitance_inverse);
+  if (!std::isfinite(growth) || growth > max_growth_) {
+    Refactorize(std::move(updated));
+    return;
+  }
+  inverse_ -= z * capacitance_inverse * w;
+  determinant_ *= lu.Determinant();
+  a_ = std::move(updated);
+}
+
+void IncrementalInverse::UpdateRow(int row, const Matrix& delta) {
+  int n = a_.GetRows();
+  if (row < 0 || row >= n) throw std::out_of_range("Index is outside the matrix");
+  Matrix u(n, 1);
+  u(row, 0) = 1;
+  Update(u, delta.Transpose());
+}
+
+void IncrementalInverse::UpdateColumn(int col, const Matrix& delta) {
+  int n = a_.GetRows();
+  if (col < 0 || col >= n) throw std::out_of_range("Index is outside the matrix");
+  Matrix v(n, 1);
+  v(col, 0) = 1;
+  Update(delta, v);
+}
@@ -0,0 +1,46 @@
+#ifndef SRC_CORE_LOW_RANK_UPDATE_H_
+#define SRC_CORE_LOW_RANK_UPDATE_H_
+
+#include "matrix_oop.h"
+
+// Keeps the inverse and determinant of a square matrix current under low
+// rank changes A += U * V^T. A rank k update costs O(n^2 * k) through the
+// Sherman-Morrison-Woodbury formula and the matrix determinant lemma instead
+// of a fresh O(n^3) factorization. When solving with the k x k capacitance
+// matrix C = I + V^T * A^-1 * U would amplify rounding errors too much (the
+// update nearly cancels, or C is singular), the inverse is recomputed from
+// the updated matrix instead.
+class IncrementalInverse {
+ private:
+  Matrix a_;
+  Matrix inverse_;
+  double determinant_;
+  double max_growth_;
+  int refactorizations_;
+
+  void Refactorize(Matrix&& matrix);
+
+ public:
+  explicit IncrementalInverse(const Matrix& matrix);
+  // Starts from an inverse and determinant computed elsewhere
+  IncrementalInverse(const Matrix& matrix, const Matrix& inverse,
+                     double determinant);
+
+  const Matrix& GetMatrix() const noexcept;
+  const Matrix& GetInverse() const noexcept;
+  double Determinant() const noexcept;
+  // Number of times the inverse was recomputed from scratch
+  int GetRefactorizations() const noexcept;
+  // Largest accepted ||C^-1|| * (1 + ||V^T * A^-1 * U||) before an update
+  // refactorizes instead (1e8 by default)
+  void SetMaxGrowth(double growth);
+
+  // A += U * V^T for n x k matrices U and V
+  void Update(const Matrix& u, const Matrix& v);
+  // Adds a 1 x n matrix to one row of A
+  void UpdateRow(int row, const Matrix& delta);
+  // Adds an n x 1 matrix to one column of A
+  void UpdateColumn(int col, const Matrix& delta);
+};
+
+#endif  // SRC_CORE_LOW_RANK_UPDATE_H_
@@ -0,0 +1,276 @@
+#include "matrix_io.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Upper bound on the shortest round-trip form of a double
+constexpr std::size_t kMaxNumberLength = 32;
+// Text formatted per thread before it is written out
+constexpr std::size_t kBlockBytes = std::size_t{4} << 20;
+
+bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+bool Whitespace(char delimiter) {
+  return delimiter == ' ' || delimiter == '\t';
+}
+
+using Line = std::pair<const char*, const char*>;
+
+// Non-blank lines of the text, without the line break
+std::vector<Line> SplitLines(std::string_view text) {
+  std::vector<Line> lines;
+  const char* position = text.data();
+  const char* end = text.data() + text.size();
+  while (position < end) {
+    const void* found = std::memchr(position, '\n', end - position);
+    const char* line_end = found ? static_cast<const char*>(found) : end;
+    const char* content = position;
+    while (content < line_end && IsBlank(*content)) content++;
+    if (content < line_end) lines.emplace_back(position, line_end);
+    position = line_end + 1;
+  }
+  return lines;
+}
+
+// Parses up to `count` values of one line into out (when non-null) and
+// returns how many values the line holds, or -1 if a value is malformed
+int ParseLine(Line line, char delimiter, double* out, int count) {
+  const char* position = line.first;
+  const char* end = line.second;
+  int parsed = 0;
+  bool whitespace = Whitespace(delimiter);
+  while (true) {
+    while (position < end && IsBlank(*position)) position++;
+    if (position == end) return whitespace ? parsed : -1;
+    if (*position == '+') {
+      position++;
+      if (position < end && (*position == '+' || *position == '-')) return -1;
+    }
+    double value = 0;
+    auto [next, error] = std::from_chars(position, end, value);
+    if (error == std::errc::result_out_of_range) {
+      // from_chars leaves value untouched; strtod gives +-HUGE_VAL on
+      // overflow and the nearest denormal or signed zero on underflow
+      value = std::strtod(std::string(position, next).c_str(), nullptr);
+    } else if (error != std::errc()) {
+      return -1;
+    }
+    if (out != nullptr && parsed < count) out[parsed] = value;
+    parsed++;
+    position = next;
+    while (position < end && IsBlank(*position)) position++;
+    if (position == end) return parsed;
+    if (whitespace) {
+      if (next == position) return -1;  // No separator after the number
+    } else {
+      if (*position != delimiter) return -1;
+      position++;
+    }
+  }
+}
+
+std::string LineError(std::size_t line) {
+  return "Incorrect input, can't parse row " + std::to_string(line + 1);
+}
+
+Matrix ParseLines(const std::vector<Line>& lines, char delimiter) {
+  if (lines.empty()) return Matrix();
+  if (delimiter == 0) {
+    const char* comma = static_cast<const char*>(std::memchr(
+        lines[0].first, ',', lines[0].second - lines[0].first));
+    delimiter = comma ? ',' : ' ';
+  }
+  int cols = ParseLine(lines[0], delimiter, nullptr, 0);
+  if (cols <= 0) throw std::invalid_argument(LineError(0));
+  int rows = static_cast<int>(lines.size());
+  Matrix result(rows, cols);
+  // Threads must not throw, so each one records its first bad row
+  std::vector<std::size_t> failures;
+  std::mutex failures_mutex;
+  parallel::For(rows, cols * 8, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      if (ParseLine(lines[i], delimiter, &result(i, 0), cols) != cols) {
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        failures.push_back(i);
+        return;
+      }
+    }
+  });
+  if (!failures.empty()) {
+    std::size_t first = failures[0];
+    for (std::size_t failure : failures) first = std::min(first, failure);
+    throw std::invalid_argument(LineError(first));
+  }
+  return result;
+}
+
+// Appends rows [begin, end) to out
+void FormatRows(const Matrix& matrix, int begin, int end, char delimiter,
+                std::string* out) {
+  int cols = matrix.GetCols();
+  char number[kMaxNumberLength];
+  for (int i = begin; i < end; i++) {
+    for (int j = 0; j < cols; j++) {
+      if (j > 0) out->push_back(delimiter);
+      char* last = std::to_chars(number, number + kMaxNumberLength,
+                                 matrix(i, j)).ptr;
+      out->append(number, last);
+    }
+    out->push_back('\n');
+  }
+}
+
+// Formats the matrix in rounds of one block of rows per thread, each at most
+// about kBlockBytes long, and passes the blocks to sink in row order before
+// starting the next round, so memory use does not grow with the matrix
+template <class Sink>
+void FormatBlocks(const Matrix& matrix, char delimiter, const Sink& sink) {
+  if (delimiter == 0) delimiter = ' ';
+  int rows = matrix.GetRows(), cols = matrix.GetCols();
+  if (rows == 0) return;
+  std::size_t row_bytes =
+      static_cast<std::size_t>(cols) * (kMaxNumberLength + 1);
+  int block_rows = static_cast<int>(
+      std::clamp<std::size_t>(kBlockBytes / row_bytes, 1, rows));
+  int threads = std::max(parallel::ThreadCount(), 1);
+  std::vector<std::string> blocks(threads);
+  for (std::string& block : blocks)
+    block.reserve(static_cast<std::size_t>(block_rows) * row_bytes);
+  for (int start = 0; start < rows;) {
+    int round_rows = static_cast<int>(std::min<long long>(
+        static_cast<long long>(block_rows) * threads, rows - start));
+    int count = (round_rows + block_rows - 1) / block_rows;
+    parallel::For(count, static_cast<std::size_t>(block_rows) * cols * 4,
+                  [&](int begin, int end) {
+                    for (int b = begin; b < end; b++) {
+                      int first = start + b * block_rows;
+                      int last =
+                          std::min(first + block_rows, start + round_rows);
+                      blocks[b].clear();
+                      FormatRows(matrix, first, last, delimiter, &blocks[b]);
+                    }
+                  });
+    for (int b = 0; b < count; b++) sink(blocks[b]);
+    start += round_rows;
+  }
+}
+
+#if defined(__linux__)
+
+// Read-only mapping of a whole file
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Can't open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      throw std::runtime_error("Can't read " + path);
+    }
+    size_ = static_cast<std::size_t>(info.st_size);
+    if (size_ > 0) {
+      data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data_ == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Can't map " + path);
+      }
+      madvise(data_, size_, MADV_WILLNEED);
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) munmap(data_, size_);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view View() const {
+    return {static_cast<const char*>(data_), size_};
+  }
+
+ private:
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+#else
+
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Can't open " + path);
+    text_.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+
+  std::string_view View() const { return text_; }
+
+ private:
+  std::string text_;
+};
+
+#endif
+
+}  // namespace
+
+Matrix ParseMatrix(std::string_view text, char delimiter) {
+  return ParseLines(SplitLines(text), delimiter);
+}
+
+Matrix ReadMatrix(const std::string& path, char delimiter) {
+  MappedFile file(path);
+  return ParseMatrix(file.View(), delimiter);
+}
+
+std::string FormatMatrix(const Matrix& matrix, char delimiter) {
+  std::string result;
+  FormatBlocks(matrix, delimiter,
+               [&](const std::string& chunk) { result += chunk; });
+  return result;
+}
+
+void WriteMatrix(const Matrix& matrix, const std::string& path,
+                 char delimiter) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("Can't open " + path);
+  FormatBlocks(matrix, delimiter, [&](const std::string& chunk) {
+    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  });
+  if (!out.flush()) throw std::runtime_error("Can't write " + path);
+}
+
+std::ostream& operator<<(std::ostream& out, const Matrix& matrix) {
+  FormatBlocks(matrix, ' ', [&](const std::string& chunk) {
+    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  });
+  return out;
+}
+
+std::istream& operator>>(std::istream& in, Matrix& matrix) {
+  std::string text(std::istreambuf_iterator<char>(in), {});
+  matrix = ParseMatrix(text, ' ');
+  return in;
+}
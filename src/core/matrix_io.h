@@ -0,0 +1,31 @@
+#ifndef SRC_CORE_MATRIX_IO_H_
+#define SRC_CORE_MATRIX_IO_H_
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "matrix_oop.h"
+
+// Text input and output of matrices, one row per line. Values are separated
+// either by a delimiter such as ',' (CSV) or, for ' ' and '\t', by runs of
+// whitespace. A delimiter of 0 picks ',' when the first row contains one and
+// whitespace otherwise. Blank lines are skipped; every other line must have
+// as many values as the first, which sets the number of columns.
+//
+// Numbers are converted with std::from_chars / std::to_chars, and written in
+// the shortest form that reads back to the same double.
+
+Matrix ParseMatrix(std::string_view text, char delimiter = 0);
+// Maps the file into memory and parses its lines in parallel
+Matrix ReadMatrix(const std::string& path, char delimiter = 0);
+
+std::string FormatMatrix(const Matrix& matrix, char delimiter = ' ');
+void WriteMatrix(const Matrix& matrix, const std::string& path,
+                 char delimiter = ' ');
+
+// Whitespace separated text; operator>> consumes the rest of the stream
+std::ostream& operator<<(std::ostream& out, const Matrix& matrix);
+std::istream& operator>>(std::istream& in, Matrix& matrix);
+
+#endif  // SRC_CORE_MATRIX_IO_H_
@@ -1,27 +1,92 @@
 #include "matrix_oop.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "allocation.h"
+#include "factorization.h"
+#include "kernels.h"
+#include "parallel.h"
+#include "profiler.h"
+
+namespace {
+
+// Fills dst[0, n) with op(j). Streaming rows go through non-temporal stores,
+// which need 16-byte alignment, so the unaligned head is written normally.
+template <class Op>
+void StoreRow(double *dst, int n, bool streaming, const Op &op) {
+  int j = 0;
+#if defined(__SSE2__)
+  if (streaming) {
+    for (; j < n && reinterpret_cast<std::uintptr_t>(dst + j) % 16 != 0; j++)
+      dst[j] = op(j);
+    for (; j + 1 < n; j += 2)
+      _mm_stream_pd(dst + j, _mm_set_pd(op(j + 1), op(j)));
+  }
+#else
+  (void)streaming;
+#endif
+  for (; j < n; j++) dst[j] = op(j);
+}
+
+// Sets dst[i][j] = op(i, j) for the whole matrix, splitting rows across
+// threads. Streaming stores are only worth it for outputs that are not read
+// back by the same kernel and do not fit in the cache anyway.
+template <class Op>
+void StoreElementwise(double **dst, int rows, int cols, bool allow_streaming,
+                      const Op &op) {
+  std::size_t bytes = static_cast<std::size_t>(rows) * cols * sizeof(double);
+  bool streaming = allow_streaming && bytes > parallel::StreamingThreshold();
+  parallel::For(rows, cols, [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      StoreRow(dst[i], cols, streaming, [&](int j) { return op(i, j); });
+#if defined(__SSE2__)
+    if (streaming) _mm_sfence();
+#endif
+  });
+}
+
+void FillZero(double **rows, int count, int cols) {
+  for (int i = 0; i < count; i++) std::fill(rows[i], rows[i] + cols, 0.0);
+}
+
+// Symmetric matrices are diagonalized instead of squared when binary
+// powering would need more products than this
+constexpr int kEigenPowerProducts = 24;
+
+}  // namespace
+
 Matrix::Matrix() {
   rows_ = 0;
   cols_ = 0;
   matrix_ = nullptr;
+  mapped_ = false;
 }
 
 Matrix::Matrix(int rows, int cols) : rows_(rows), cols_(cols) {
   if (rows_ < 0 || cols_ < 0) {
     throw std::invalid_argument("Arguments less than zero");
   }
+  if (rows_ > 0 && cols_ == 0) {
+    throw std::invalid_argument("Rows of a matrix can't be empty");
+  }
   AllocateMemory();
 }
 
 Matrix::Matrix(const Matrix &other)
     : rows_(other.rows_), cols_(other.cols_) {
   AllocateMemory();
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) this->matrix_[i][j] = other.matrix_[i][j];
+  CopyMatrix(other);
 }
 
 Matrix::Matrix(Matrix &&other) noexcept {
   matrix_ = other.matrix_;
+  mapped_ = other.mapped_;
   cols_ = other.cols_;
   rows_ = other.rows_;
   other.matrix_ = nullptr;
@@ -29,6 +94,10 @@ Matrix::Matrix(Matrix &&other) noexcept {
   other.cols_ = 0;
 }
 
+Matrix::Matrix(const MatrixProduct &product) : Matrix() {
+  product.EvaluateInto(this);
+}
+
 Matrix::~Matrix() { RemoveMatrix(); }
 
 int Matrix::GetRows() const noexcept { return rows_; }
@@ -84,45 +153,46 @@ bool Matrix::EqMatrix(const Matrix &other) const {
 }
 
 void Matrix::SumMatrix(const Matrix &other) {
+  ProfileScope scope("SumMatrix", rows_, cols_);
   if (rows_ != other.rows_ || cols_ != other.cols_) {
     throw std::invalid_argument("Incorrect input, different size of matrices");
   }
-  for (int i = 0; i < this->rows_; i++)
-    for (int j = 0; j < this->cols_; j++)
-      this->matrix_[i][j] += other.matrix_[i][j];
+  StoreElementwise(matrix_, rows_, cols_, false, [&](int i, int j) {
+    return matrix_[i][j] + other.matrix_[i][j];
+  });
 }
 
 void Matrix::SubMatrix(const Matrix &other) {
+  ProfileScope scope("SubMatrix", rows_, cols_);
   if (rows_ != other.rows_ || cols_ != other.cols_) {
     throw std::invalid_argument("Incorrect input, different size of matrices");
   }
-  for (int i = 0; i < this->rows_; i++)
-    for (int j = 0; j < this->cols_; j++)
-      this->matrix_[i][j] -= other.matrix_[i][j];
+  StoreElementwise(matrix_, rows_, cols_, false, [&](int i, int j) {
+    return matrix_[i][j] - other.matrix_[i][j];
+  });
 }
 
 void Matrix::MulNumber(const double num) {
-  for (int i = 0; i < this->rows_; i++)
-    for (int j = 0; j < this->cols_; j++) this->matrix_[i][j] *= num;
+  ProfileScope scope("MulNumber", rows_, cols_);
+  StoreElementwise(matrix_, rows_, cols_, false,
+                   [&](int i, int j) { return matrix_[i][j] * num; });
 }
 
 void Matrix::MulMatrix(const Matrix &other) {
+  ProfileScope scope("MulMatrix", rows_, other.cols_);
   if (cols_ != other.rows_) {
     throw std::invalid_argument("Incorrect input, different size of matrices");
   }
   Matrix result(rows_, other.cols_);
-  for (int i = 0; i < rows_; i++) {
-    for (int j = 0; j < other.cols_; j++) {
-      for (int k = 0; k < cols_; k++) {
-        result.matrix_[i][j] += this->matrix_[i][k] * other.matrix_[k][j];
-      }
-    }
-  }
+  kernels::Gemm(rows_, other.cols_, cols_, 1.0, kernels::MakeView(matrix_),
+                kernels::MakeView(other.matrix_),
+                kernels::MakeView(result.matrix_));
   RemoveMatrix();
   *this = std::move(result);
 }
 
 Matrix Matrix::Transpose() const {
+  ProfileScope scope("Transpose", rows_, cols_);
   Matrix result(cols_, rows_);
   for (int i = 0; i < rows_; i++) {
     for (int j = 0; j < cols_; j++) {
@@ -133,6 +203,7 @@ Matrix Matrix::Transpose() const {
 }
 
 double Matrix::Determinant() const {
+  ProfileScope scope("Determinant", rows_, cols_);
   if (cols_ != rows_) throw std::out_of_range("The matrix isn't square!");
   double result = 0;
   if (rows_ == 1) {
@@ -140,17 +211,13 @@ double Matrix::Determinant() const {
   } else if (rows_ == 2) {
     result = matrix_[0][0] * matrix_[1][1] - matrix_[0][1] * matrix_[1][0];
   } else {
-    for (int i = 0; i < cols_; i++) {
-      Matrix minor = this->GetMinor(0, i);
-      double buff = minor.Determinant();
-      double newMinor = pow(-1, i) * matrix_[0][i] * buff;
-      result += newMinor;
-    }
+    result = LUFactorization(*this).Determinant();
   }
   return result;
 }
 
 Matrix Matrix::CalcComplements() const {
+  ProfileScope scope("CalcComplements", rows_, cols_);
   if (cols_ != rows_) throw std::out_of_range("The matrix isn't square!");
   Matrix result = Matrix(rows_, cols_);
   for (int i = 0; i < result.rows_; i++)
@@ -164,46 +231,168 @@ Matrix Matrix::CalcComplements() const {
 }
 
 Matrix Matrix::InverseMatrix() const {
-  double det = this->Determinant();
-  if (det == 0)
-    throw std::invalid_argument("Incorrect input, matrix determinant is zero");
-  Matrix calc = this->CalcComplements();
-  Matrix result = calc.Transpose();
-  result.MulNumber(1.0 / det);
+  ProfileScope scope("InverseMatrix", rows_, cols_);
+  if (cols_ != rows_) throw std::out_of_range("The matrix isn't square!");
+  return LUFactorization(*this).Inverse();
+}
+
+Matrix Matrix::Power(long long power) const {
+  ProfileScope scope("Power", rows_, cols_);
+  if (cols_ != rows_) throw std::out_of_range("The matrix isn't square!");
+  if (power < 0) {
+    if (power == std::numeric_limits<long long>::min())
+      throw std::out_of_range("Power is out of range");
+    return InverseMatrix().Power(-power);
+  }
+  int products = 0;
+  for (long long rest = power; rest > 1; rest >>= 1)
+    products += 1 + static_cast<int>(rest & 1);
+  if (products > kEigenPowerProducts && IsSymmetric())
+    return PowerSymmetric(power);
+  // Square the base and multiply it into the result for every set bit.
+  // Each product goes into the spare buffer, which then swaps places with
+  // its left operand, so no step allocates.
+  int n = rows_;
+  Matrix result(n, n), base(*this), spare(n, n);
+  bool identity = true;
+  for (long long rest = power; rest > 0; rest >>= 1) {
+    if (rest & 1) {
+      if (identity) {
+        result.CopyMatrix(base);
+        identity = false;
+      } else {
+        FillZero(spare.matrix_, n, n);
+        kernels::Gemm(n, n, n, 1.0, kernels::MakeView(result.matrix_),
+                      kernels::MakeView(base.matrix_),
+                      kernels::MakeView(spare.matrix_));
+        std::swap(result, spare);
+      }
+    }
+    if (rest > 1) {
+      FillZero(spare.matrix_, n, n);
+      kernels::Gemm(n, n, n, 1.0, kernels::MakeView(base.matrix_),
+                    kernels::MakeView(base.matrix_),
+                    kernels::MakeView(spare.matrix_));
+      std::swap(base, spare);
+    }
+  }
+  if (identity)
+    for (int i = 0; i < n; i++) result.matrix_[i][i] = 1;
   return result;
 }
 
-Matrix Matrix::operator+(const Matrix &other) {
-  Matrix result(*this);
-  result.SumMatrix(other);
+Matrix Matrix::PowerSymmetric(long long power) const {
+  // A^k = V * diag(lambda^k) * V^T
+  int n = rows_;
+  Matrix eigen(*this), vectors(n, n);
+  kernels::SymmetricEigen(n, kernels::MakeView(eigen.matrix_),
+                          kernels::MakeView(vectors.matrix_));
+  Matrix scaled(vectors);
+  for (int j = 0; j < n; j++) {
+    // Past 2^53 the exponent no longer converts to double exactly, so its
+    // parity, and with it the sign of a negative eigenvalue, is taken apart
+    double lambda = eigen.matrix_[j][j];
+    double value = std::pow(std::fabs(lambda), static_cast<double>(power));
+    if (lambda < 0 && (power & 1)) value = -value;
+    for (int i = 0; i < n; i++) scaled.matrix_[i][j] *= value;
+  }
+  Matrix transposed = vectors.Transpose(), result(n, n);
+  kernels::Gemm(n, n, n, 1.0, kernels::MakeView(scaled.matrix_),
+                kernels::MakeView(transposed.matrix_),
+                kernels::MakeView(result.matrix_));
   return result;
 }
 
-Matrix Matrix::operator-(const Matrix &other) {
-  Matrix result(*this);
-  result.SubMatrix(other);
+Matrix Matrix::Exp() const {
+  ProfileScope scope("Exp", rows_, cols_);
+  if (cols_ != rows_) throw std::out_of_range("The matrix isn't square!");
+  // Scaling and squaring with the diagonal (6, 6) Pade approximant
+  // (Golub & Van Loan, algorithm 11.3.1): scale A until ||A||_inf <= 1/2,
+  // approximate e^A by D^-1 * N and square the result back up
+  const int kDegree = 6;
+  int n = rows_;
+  double norm = 0;
+  for (int i = 0; i < n; i++) {
+    double row = 0;
+    for (int j = 0; j < n; j++) row += fabs(matrix_[i][j]);
+    norm = std::max(norm, row);
+  }
+  if (!std::isfinite(norm))
+    throw std::invalid_argument("Incorrect input, matrix isn't finite");
+  int squarings = 0;
+  if (norm > 0.5)
+    squarings = static_cast<int>(std::ceil(std::log2(norm / 0.5)));
+  Matrix a = std::ldexp(1.0, -squarings) * (*this);
+  Matrix numerator(n, n), denominator(n, n), power(a), spare(n, n);
+  for (int i = 0; i < n; i++)
+    numerator.matrix_[i][i] = denominator.matrix_[i][i] = 1;
+  double c = 0.5;
+  numerator += c * a;
+  denominator -= c * a;
+  for (int k = 2; k <= kDegree; k++) {
+    c *= static_cast<double>(kDegree - k + 1) / (k * (2 * kDegree - k + 1));
+    FillZero(spare.matrix_, n, n);
+    kernels::Gemm(n, n, n, 1.0, kernels::MakeView(a.matrix_),
+                  kernels::MakeView(power.matrix_),
+                  kernels::MakeView(spare.matrix_));
+    std::swap(power, spare);
+    numerator += c * power;
+    if (k % 2 == 0) {
+      denominator += c * power;
+    } else {
+      denominator -= c * power;
+    }
+  }
+  Matrix result = LUFactorization(denominator).Solve(numerator);
+  for (int i = 0; i < squarings; i++) {
+    FillZero(spare.matrix_, n, n);
+    kernels::Gemm(n, n, n, 1.0, kernels::MakeView(result.matrix_),
+                  kernels::MakeView(result.matrix_),
+                  kernels::MakeView(spare.matrix_));
+    std::swap(result, spare);
+  }
   return result;
 }
 
-Matrix Matrix::operator*(const Matrix &other) {
-  Matrix result(*this);
-  result.MulMatrix(other);
+Matrix operator+(const Matrix &left, const Matrix &right) {
+  ProfileScope scope("operator+", left.rows_, left.cols_);
+  if (left.rows_ != right.rows_ || left.cols_ != right.cols_) {
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  }
+  Matrix result(left.rows_, left.cols_);
+  StoreElementwise(result.matrix_, left.rows_, left.cols_, true,
+                   [&](int i, int j) {
+                     return left.matrix_[i][j] + right.matrix_[i][j];
+                   });
   return result;
 }
 
-Matrix operator*(double num, const Matrix &other) {
-  Matrix result(other);
-  result.MulNumber(num);
+Matrix operator-(const Matrix &left, const Matrix &right) {
+  ProfileScope scope("operator-", left.rows_, left.cols_);
+  if (left.rows_ != right.rows_ || left.cols_ != right.cols_) {
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  }
+  Matrix result(left.rows_, left.cols_);
+  StoreElementwise(result.matrix_, left.rows_, left.cols_, true,
+                   [&](int i, int j) {
+                     return left.matrix_[i][j] - right.matrix_[i][j];
+                   });
   return result;
 }
 
-Matrix operator*(const Matrix &other, double num) {
-  Matrix result(other);
-  result.MulNumber(num);
+Matrix operator*(double num, const Matrix &other) {
+  ProfileScope scope("operator*(double)", other.rows_, other.cols_);
+  Matrix result(other.rows_, other.cols_);
+  StoreElementwise(result.matrix_, other.rows_, other.cols_, true,
+                   [&](int i, int j) { return other.matrix_[i][j] * num; });
   return result;
 }
 
-bool Matrix::operator==(const Matrix &other) { return EqMatrix(other); }
+Matrix operator*(const Matrix &other, double num) { return num * other; }
+
+bool operator==(const Matrix &left, const Matrix &right) {
+  return left.EqMatrix(right);
+}
 
 Matrix &Matrix::operator+=(const Matrix &other) {
   this->SumMatrix(other);
@@ -252,6 +441,7 @@ Matrix &Matrix::operator=(Matrix &&other) noexcept {
   if (this != &other) {
     RemoveMatrix();
     matrix_ = other.matrix_;
+    mapped_ = other.mapped_;
     cols_ = other.cols_;
     rows_ = other.rows_;
     other.matrix_ = nullptr;
@@ -261,6 +451,23 @@ Matrix &Matrix::operator=(Matrix &&other) noexcept {
   return *this;
 }
 
+Matrix &Matrix::operator=(const MatrixProduct &product) {
+  if (product.Aliases(this)) {
+    *this = product.Evaluate();
+  } else {
+    product.EvaluateInto(this);
+  }
+  return *this;
+}
+
+bool Matrix::IsSymmetric() const noexcept {
+  if (rows_ != cols_) return false;
+  for (int i = 0; i < rows_; i++)
+    for (int j = 0; j < i; j++)
+      if (matrix_[i][j] != matrix_[j][i]) return false;
+  return true;
+}
+
 Matrix Matrix::GetMinor(int rows, int cols) const {
   Matrix result = Matrix(rows_ - 1, cols_ - 1);
   int n = 0;
@@ -276,21 +483,30 @@ Matrix Matrix::GetMinor(int rows, int cols) const {
 }
 
 void Matrix::AllocateMemory() {
-  matrix_ = new double *[rows_];
-  for (int i = 0; i < rows_; i++) matrix_[i] = new double[cols_]{0};
+  // One contiguous block with row pointers into it; row 0 owns the block
+  double *data = allocation::Allocate(rows_, cols_, &mapped_);
+  try {
+    matrix_ = new double *[rows_];
+  } catch (...) {
+    allocation::Release(data, rows_, cols_, mapped_);
+    throw;
+  }
+  for (int i = 0; i < rows_; i++)
+    matrix_[i] = data ? data + static_cast<std::size_t>(i) * cols_ : nullptr;
 }
 
 void Matrix::CopyMatrix(const Matrix &other) {
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) matrix_[i][j] = other.matrix_[i][j];
+  ProfileScope scope("CopyMatrix", rows_, cols_);
+  StoreElementwise(matrix_, rows_, cols_, true,
+                   [&](int i, int j) { return other.matrix_[i][j]; });
 }
 
 void Matrix::RemoveMatrix() {
-  for (int i = 0; i < rows_; i++) {
-    delete[] matrix_[i];
-  }
+  if (matrix_ != nullptr && rows_ > 0)
+    allocation::Release(matrix_[0], rows_, cols_, mapped_);
   delete[] matrix_;
   rows_ = 0;
   cols_ = 0;
   matrix_ = nullptr;
+  mapped_ = false;
 }
@@ -4,11 +4,18 @@
 #include <cmath>
 #include <iostream>
 
+class MatrixProduct;
+class TriangularMatrix;
+class SymmetricMatrix;
+class DiagonalMatrix;
+class BandMatrix;
+
 class Matrix {
  private:
   // Attributes
   int rows_, cols_;
   double** matrix_;
+  bool mapped_;  // Elements live in a dedicated mapping, see allocation.h
 
   // Support functions
 
@@ -16,12 +23,34 @@ class Matrix {
   void CopyMatrix(const Matrix& other);
   void RemoveMatrix();
   Matrix GetMinor(int rows, int cols) const;
+  bool IsSymmetric() const noexcept;
+  Matrix PowerSymmetric(long long power) const;
+
+  friend class LUFactorization;
+  friend class CholeskyFactorization;
+  friend class QRFactorization;
+  friend class MixedPrecisionSolver;
+  friend class MatrixProduct;
+  friend class TriangularMatrix;
+  friend class SymmetricMatrix;
+  friend class DiagonalMatrix;
+  friend class BandMatrix;
+  friend Matrix operator*(const TriangularMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const TriangularMatrix& right);
+  friend Matrix operator*(const TriangularMatrix& left,
+                          const TriangularMatrix& right);
+  friend Matrix operator*(const SymmetricMatrix& left, const Matrix& right);
+  friend Matrix operator*(const DiagonalMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const DiagonalMatrix& right);
+  friend Matrix operator*(const BandMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const BandMatrix& right);
 
  public:
   Matrix();                            // Default constructor
   Matrix(int rows, int cols);          // Parameterized constructor
   Matrix(const Matrix& other);      // Copy constructor
   Matrix(Matrix&& other) noexcept;  // Move constructor
+  Matrix(const MatrixProduct& product);  // Evaluates a product chain
   ~Matrix();                           // Destructor
 
   // Getters and Setters
@@ -51,17 +80,27 @@ class Matrix {
   Matrix CalcComplements() const;
   // Calculates and returns the inverse matrix
   Matrix InverseMatrix() const;
+  // Raises the matrix to an integer power with O(log |power|) products;
+  // negative powers invert first
+  Matrix Power(long long power) const;
+  // Calculates the matrix exponential e^A
+  Matrix Exp() const;
 
   // Operator overloading
 
-  Matrix operator+(const Matrix& other);
-  Matrix operator-(const Matrix& other);
-  Matrix operator*(const Matrix& other);
+  // Binary operators are free functions so that a pending MatrixProduct
+  // converts on either side. Matrix * Matrix builds a MatrixProduct, see
+  // matrix_product.h.
+
+  friend Matrix operator+(const Matrix& left, const Matrix& right);
+  friend Matrix operator-(const Matrix& left, const Matrix& right);
   friend Matrix operator*(const Matrix& other, double num);
   friend Matrix operator*(double num, const Matrix& other);
-  bool operator==(const Matrix& other);
+  friend bool operator==(const Matrix& left, const Matrix& right);
   Matrix& operator=(const Matrix& other);
   Matrix& operator=(Matrix&& other) noexcept;
+  // Evaluates the chain, reusing this matrix's storage when the shape fits
+  Matrix& operator=(const MatrixProduct& product);
   Matrix& operator+=(const Matrix& other);
   Matrix& operator-=(const Matrix& right);
   Matrix& operator*=(const Matrix& right);
@@ -70,4 +109,10 @@ class Matrix {
   double operator()(int rows, int cols) const;
 };
 
+Matrix operator+(const Matrix& left, const Matrix& right);
+Matrix operator-(const Matrix& left, const Matrix& right);
+bool operator==(const Matrix& left, const Matrix& right);
+
+#include "matrix_product.h"
+
 #endif  // SRC_S21_MATRIX_OOP_H_
@@ -0,0 +1,201 @@
+#include "matrix_product.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "kernels.h"
+#include "profiler.h"
+
+namespace {
+
+// Intermediate results released by one branch of the chain are handed to the
+// next branch that needs the same shape instead of being reallocated. Reused
+// buffers come back with their old contents.
+class ScratchPool {
+ public:
+  Matrix Acquire(int rows, int cols) {
+    for (auto it = free_.begin(); it != free_.end(); ++it) {
+      if (it->GetRows() == rows && it->GetCols() == cols) {
+        Matrix result = std::move(*it);
+        free_.erase(it);
+        return result;
+      }
+    }
+    return Matrix(rows, cols);
+  }
+
+  void Release(Matrix&& matrix) { free_.push_back(std::move(matrix)); }
+
+ private:
+  std::vector<Matrix> free_;
+};
+
+}  // namespace
+
+MatrixProduct::MatrixProduct(const Matrix& matrix)
+    : factors_{std::shared_ptr<const Matrix>(&matrix, [](const Matrix*) {})},
+      scale_(1) {}
+
+MatrixProduct::MatrixProduct(Matrix&& matrix)
+    : factors_{std::make_shared<const Matrix>(std::move(matrix))}, scale_(1) {}
+
+int MatrixProduct::GetRows() const noexcept {
+  return factors_.front()->GetRows();
+}
+
+int MatrixProduct::GetCols() const noexcept {
+  return factors_.back()->GetCols();
+}
+
+int MatrixProduct::GetLength() const noexcept {
+  return static_cast<int>(factors_.size());
+}
+
+double MatrixProduct::Cost() const {
+  double cost = 0;
+  Ordering(&cost);
+  return cost;
+}
+
+std::vector<int> MatrixProduct::Dimensions() const {
+  std::vector<int> result;
+  result.reserve(factors_.size() + 1);
+  for (const auto& factor : factors_) result.push_back(factor->GetRows());
+  result.push_back(GetCols());
+  return result;
+}
+
+std::vector<std::vector<int>> MatrixProduct::Ordering(double* cost) const {
+  // Classic O(n^3) matrix chain dynamic program; best[i * n + j] is the
+  // cheapest way to multiply factors i..j
+  int n = GetLength();
+  std::vector<int> p = Dimensions();
+  std::vector<double> best(static_cast<std::size_t>(n) * n, 0);
+  std::vector<std::vector<int>> split(n, std::vector<int>(n, 0));
+  for (int length = 2; length <= n; length++) {
+    for (int i = 0; i + length - 1 < n; i++) {
+      int j = i + length - 1;
+      double& entry = best[i * n + j];
+      entry = std::numeric_limits<double>::infinity();
+      for (int k = i; k < j; k++) {
+        double candidate = best[i * n + k] + best[(k + 1) * n + j] +
+                           static_cast<double>(p[i]) * p[k + 1] * p[j + 1];
+        if (candidate < entry) {
+          entry = candidate;
+          split[i][j] = k;
+        }
+      }
+    }
+  }
+  *cost = best[n - 1];
+  return split;
+}
+
+bool MatrixProduct::Aliases(const Matrix* matrix) const noexcept {
+  for (const auto& factor : factors_)
+    if (factor.get() == matrix) return true;
+  return false;
+}
+
+void MatrixProduct::EvaluateInto(Matrix* result) const {
+  ProfileScope scope("MatrixProduct", GetRows(), GetCols());
+  int rows = GetRows(), cols = GetCols();
+  if (GetLength() == 1) {
+    *result = *factors_.front();
+    *result *= scale_;
+    return;
+  }
+  auto zero = [](Matrix* matrix) {
+    for (int i = 0; i < matrix->rows_; i++)
+      std::fill(matrix->matrix_[i], matrix->matrix_[i] + matrix->cols_, 0.0);
+  };
+  if (result->rows_ == rows && result->cols_ == cols) {
+    zero(result);
+  } else {
+    *result = Matrix(rows, cols);
+  }
+  double cost = 0;
+  std::vector<std::vector<int>> split = Ordering(&cost);
+  std::vector<int> p = Dimensions();
+  ScratchPool pool;
+  // Accumulates alpha * (factors i..j) into out, which is already zeroed
+  auto multiply = [&](auto& self, int i, int j, double alpha,
+                      Matrix* out) -> void {
+    int k = split[i][j];
+    Matrix left, right;
+    const Matrix* left_operand = factors_[i].get();
+    const Matrix* right_operand = factors_[j].get();
+    if (k > i) {
+      left = pool.Acquire(p[i], p[k + 1]);
+      zero(&left);
+      self(self, i, k, 1.0, &left);
+      left_operand = &left;
+    }
+    if (k + 1 < j) {
+      right = pool.Acquire(p[k + 1], p[j + 1]);
+      zero(&right);
+      self(self, k + 1, j, 1.0, &right);
+      right_operand = &right;
+    }
+    kernels::Gemm(p[i], p[j + 1], p[k + 1], alpha,
+                  kernels::MakeView(left_operand->matrix_),
+                  kernels::MakeView(right_operand->matrix_),
+                  kernels::MakeView(out->matrix_));
+    if (k > i) pool.Release(std::move(left));
+    if (k + 1 < j) pool.Release(std::move(right));
+  };
+  multiply(multiply, 0, GetLength() - 1, scale_, result);
+}
+
+Matrix MatrixProduct::Evaluate() const {
+  Matrix result;
+  EvaluateInto(&result);
+  return result;
+}
+
+double MatrixProduct::operator()(int row, int col) const {
+  return static_cast<const Matrix&>(Evaluate())(row, col);
+}
+
+bool MatrixProduct::EqMatrix(const Matrix& other) const {
+  return Evaluate().EqMatrix(other);
+}
+
+Matrix MatrixProduct::Transpose() const { return Evaluate().Transpose(); }
+
+double MatrixProduct::Determinant() const { return Evaluate().Determinant(); }
+
+Matrix MatrixProduct::CalcComplements() const {
+  return Evaluate().CalcComplements();
+}
+
+Matrix MatrixProduct::InverseMatrix() const {
+  return Evaluate().InverseMatrix();
+}
+
+Matrix MatrixProduct::Power(long long power) const {
+  return Evaluate().Power(power);
+}
+
+Matrix MatrixProduct::Exp() const { return Evaluate().Exp(); }
+
+MatrixProduct operator*(MatrixProduct left, MatrixProduct right) {
+  if (left.GetCols() != right.GetRows()) {
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+  }
+  left.factors_.insert(left.factors_.end(), right.factors_.begin(),
+                       right.factors_.end());
+  left.scale_ *= right.scale_;
+  return left;
+}
+
+MatrixProduct operator*(MatrixProduct product, double num) {
+  product.scale_ *= num;
+  return product;
+}
+
+MatrixProduct operator*(double num, MatrixProduct product) {
+  return std::move(product) * num;
+}
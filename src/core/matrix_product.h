@@ -0,0 +1,67 @@
+#ifndef SRC_CORE_MATRIX_PRODUCT_H_
+#define SRC_CORE_MATRIX_PRODUCT_H_
+
+#include <memory>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Unevaluated product of a chain of matrices, built by operator*. The chain
+// is multiplied only when it is converted or assigned to a Matrix, in the
+// order that needs the fewest scalar multiplications for the actual shapes,
+// so A * B * v never forms A * B when A * (B * v) is cheaper.
+//
+// Named operands are held by reference and temporaries are moved into the
+// expression, so the only lifetime rule is that named operands outlive the
+// product: auto p = a * b stays valid while a and b exist, and sees their
+// values at the time it is evaluated.
+//
+// Before products became lazy, operator* returned a Matrix. The const Matrix
+// members below evaluate the chain and forward to it, so expressions such as
+// (a * b)(i, j) and (a * b).Transpose() keep compiling; each call multiplies
+// the chain out again, so store the product in a Matrix to reuse it.
+class MatrixProduct {
+ private:
+  std::vector<std::shared_ptr<const Matrix>> factors_;
+  double scale_;
+
+  // Dimensions p such that factor i is p[i] x p[i + 1]
+  std::vector<int> Dimensions() const;
+  // split[i][j] is the last factor of the left operand of chain i..j
+  std::vector<std::vector<int>> Ordering(double* cost) const;
+  bool Aliases(const Matrix* matrix) const noexcept;
+  void EvaluateInto(Matrix* result) const;
+
+  friend class Matrix;
+
+ public:
+  MatrixProduct(const Matrix& matrix);  // References the matrix
+  MatrixProduct(Matrix&& matrix);       // Takes ownership of a temporary
+
+  int GetRows() const noexcept;
+  int GetCols() const noexcept;
+  // Number of factors in the chain
+  int GetLength() const noexcept;
+  // Scalar multiplications needed by the optimal ordering
+  double Cost() const;
+  // Multiplies the chain out
+  Matrix Evaluate() const;
+
+  // Matrix interface, evaluating the chain first
+  double operator()(int row, int col) const;
+  bool EqMatrix(const Matrix& other) const;
+  Matrix Transpose() const;
+  double Determinant() const;
+  Matrix CalcComplements() const;
+  Matrix InverseMatrix() const;
+  Matrix Power(long long power) const;
+  Matrix Exp() const;
+
+  friend MatrixProduct operator*(MatrixProduct left, MatrixProduct right);
+  friend MatrixProduct operator*(MatrixProduct product, double num);
+  friend MatrixProduct operator*(double num, MatrixProduct product);
+};
+
+MatrixProduct operator*(MatrixProduct left, MatrixProduct right);
+
+#endif  // SRC_CORE_MATRIX_PRODUCT_H_
@@ -0,0 +1,190 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#include "profiler.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace parallel {
+
+namespace {
+
+int DefaultThreadCount() {
+  unsigned hardware = std::thread::hardware_concurrency();
+  return hardware == 0 ? 1 : static_cast<int>(hardware);
+}
+
+// Size of the last level cache, or 32 MB when the system doesn't report it
+std::size_t DefaultStreamingThreshold() {
+  long cache = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+  cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (cache <= 0) cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  return cache > 0 ? static_cast<std::size_t>(cache) : std::size_t{32} << 20;
+}
+
+std::atomic<int> thread_count{DefaultThreadCount()};
+std::atomic<std::size_t> serial_threshold{std::size_t{1} << 16};
+std::atomic<std::size_t> streaming_threshold{DefaultStreamingThreshold()};
+
+}  // namespace
+
+int ThreadCount() noexcept { return thread_count.load(); }
+
+void SetThreadCount(int count) {
+  if (count <= 0) throw std::invalid_argument("Thread count must be positive");
+  thread_count.store(count);
+}
+
+std::size_t SerialThreshold() noexcept { return serial_threshold.load(); }
+
+void SetSerialThreshold(std::size_t elements) {
+  serial_threshold.store(elements);
+}
+
+std::size_t StreamingThreshold() noexcept { return streaming_threshold.load(); }
+
+void SetStreamingThreshold(std::size_t bytes) {
+  streaming_threshold.store(bytes);
+}
+
+namespace {
+
+// Ranges of one For call, claimed one at a time by the caller and by the
+// pool tasks helping it. Shared with those tasks, which may only start after
+// the call returned and then find nothing left to claim.
+struct Ranges {
+  const std::function<void(int, int)>* body;
+  int count, ranges;
+  bool profiled;
+  std::atomic<int> next{0};
+  std::mutex mutex;
+  std::condition_variable done;
+  int finished = 0;
+  std::exception_ptr error;
+  // Hardware counters of the helpers, credited to the caller afterwards
+  std::array<long long, Profiler::kCounterCount> counts{};
+
+  int Begin(int range) const {
+    int chunk = count / ranges, extra = count % ranges;
+    return range * chunk + std::min(range, extra);
+  }
+
+  void Run(bool helper) {
+    for (int range = next++; range < ranges; range = next++) {
+      bool measured = helper && profiled;
+      std::array<long long, Profiler::kCounterCount> start{}, end{};
+      if (measured) start = ProfileScope::ThreadCounters();
+      std::exception_ptr caught;
+      try {
+        (*body)(Begin(range), Begin(range + 1));
+      } catch (...) {
+        caught = std::current_exception();
+      }
+      if (measured) end = ProfileScope::ThreadCounters();
+      std::lock_guard<std::mutex> lock(mutex);
+      for (int i = 0; measured && i < Profiler::kCounterCount; i++)
+        if (start[i] >= 0 && end[i] >= 0) counts[i] += end[i] - start[i];
+      if (caught && !error) error = caught;
+      if (++finished == ranges) done.notify_all();
+    }
+  }
+};
+
+}  // namespace
+
+void For(int count, std::size_t work_per_item,
+         const std::function<void(int, int)>& body) {
+  if (count <= 0) return;
+  std::size_t work = static_cast<std::size_t>(count) * work_per_item;
+  std::size_t threshold = std::max<std::size_t>(SerialThreshold(), 1);
+  // Every thread gets at least SerialThreshold() elements of work
+  std::size_t useful = std::max<std::size_t>(work / threshold, 1);
+  int threads = static_cast<int>(std::min<std::size_t>(
+      std::min<std::size_t>(ThreadCount(), useful), count));
+  if (threads <= 1) {
+    body(0, count);
+    return;
+  }
+  auto ranges = std::make_shared<Ranges>();
+  ranges->body = &body;
+  ranges->count = count;
+  ranges->ranges = threads;
+  ranges->profiled = Profiler::Instance().IsEnabled();
+  // Whatever is not handed to the pool, the caller runs itself
+  try {
+    ThreadPool& pool = ThreadPool::Default();
+    pool.EnsureThreads(ThreadCount());
+    for (int t = 1; t < threads; t++)
+      pool.Submit([ranges] { ranges->Run(true); });
+  } catch (...) {
+  }
+  ranges->Run(false);
+  std::unique_lock<std::mutex> lock(ranges->mutex);
+  ranges->done.wait(lock, [&] { return ranges->finished == ranges->ranges; });
+  if (ranges->profiled) ProfileScope::CreditWorker(ranges->counts);
+  if (ranges->error) std::rethrow_exception(ranges->error);
+}
+
+}  // namespace parallel
+
+ThreadPool::ThreadPool(int threads) : stopping_(false) {
+  if (threads <= 0) throw std::invalid_argument("Thread count must be positive");
+  EnsureThreads(threads);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  available_.notify_all();
+  for (auto& worker : workers_) worker.join();
+}
+
+int ThreadPool::GetThreads() const noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<int>(workers_.size());
+}
+
+void ThreadPool::EnsureThreads(int threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (static_cast<int>(workers_.size()) < threads)
+    workers_.emplace_back([this] { Work(); });
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push(std::move(task));
+  }
+  available_.notify_one();
+}
+
+void ThreadPool::Work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+ThreadPool& ThreadPool::Default() {
+  static ThreadPool pool(parallel::ThreadCount());
+  return pool;
+}
@@ -0,0 +1,67 @@
+#ifndef SRC_CORE_PARALLEL_H_
+#define SRC_CORE_PARALLEL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Set of persistent worker threads running queued tasks in FIFO order
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  mutable std::mutex mutex_;
+  std::condition_variable available_;
+  bool stopping_;
+
+  void Work();
+
+ public:
+  explicit ThreadPool(int threads);
+  ~ThreadPool();  // Finishes the queued tasks and joins the workers
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int GetThreads() const noexcept;
+  // Starts workers until there are at least `threads` of them
+  void EnsureThreads(int threads);
+  void Submit(std::function<void()> task);
+
+  // Pool shared by the asynchronous operations and parallel::For, one
+  // worker per thread of parallel::ThreadCount()
+  static ThreadPool& Default();
+};
+
+namespace parallel {
+
+// Number of threads used by the parallel kernels (hardware concurrency by
+// default)
+int ThreadCount() noexcept;
+void SetThreadCount(int count);
+
+// Operations touching fewer elements than this run on the calling thread
+std::size_t SerialThreshold() noexcept;
+void SetSerialThreshold(std::size_t elements);
+
+// Outputs larger than this many bytes are written with non-temporal stores,
+// so they bypass the cache instead of evicting the inputs (defaults to the
+// last level cache size reported by sysconf, or 32 MB if it isn't available)
+std::size_t StreamingThreshold() noexcept;
+void SetStreamingThreshold(std::size_t bytes);
+
+// Splits [0, count) into one contiguous range per thread and calls
+// body(begin, end) for each range. The calling thread runs ranges itself and
+// idle workers of ThreadPool::Default() take the others, so For never waits
+// for a busy pool and may be called from pool tasks. Runs serially when
+// count * work_per_item is below SerialThreshold(). If body throws, the
+// first exception is rethrown once every range has finished.
+void For(int count, std::size_t work_per_item,
+         const std::function<void(int, int)>& body);
+
+}  // namespace parallel
+
+#endif  // SRC_CORE_PARALLEL_H_
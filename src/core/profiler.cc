@@ -0,0 +1,271 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace {
+
+// Smallest power of two not below size; sizes past 2^30, whose bucket would
+// not fit an int, share the bucket INT_MAX
+int Bucket(int size) {
+  if (size <= 0) return 0;
+  if (size > (1 << 30)) return std::numeric_limits<int>::max();
+  int result = 1;
+  while (result < size) result <<= 1;
+  return result;
+}
+
+std::int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#if defined(__linux__)
+
+// perf events of the calling thread, opened the first time the thread runs a
+// profiled kernel
+class CounterSet {
+ public:
+  explicit CounterSet(std::uint64_t vector_event) : vector_event_(vector_event) {
+    const std::uint64_t l1_read_miss =
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    Open(Profiler::kCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    Open(Profiler::kInstructions, PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_INSTRUCTIONS);
+    Open(Profiler::kL1Misses, PERF_TYPE_HW_CACHE, l1_read_miss);
+    Open(Profiler::kLlcMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    Open(Profiler::kBranchMisses, PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_BRANCH_MISSES);
+    if (vector_event != 0)
+      Open(Profiler::kVectorInstructions, PERF_TYPE_RAW, vector_event);
+  }
+
+  ~CounterSet() {
+    for (int fd : fds_)
+      if (fd >= 0) close(fd);
+  }
+
+  std::uint64_t GetVectorEvent() const noexcept { return vector_event_; }
+
+  bool Any() const noexcept {
+    for (int fd : fds_)
+      if (fd >= 0) return true;
+    return false;
+  }
+
+  // Current values, scaled up when the kernel had to multiplex counters
+  void Read(std::array<long long, Profiler::kCounterCount>* values) const {
+    for (int i = 0; i < Profiler::kCounterCount; i++) {
+      (*values)[i] = -1;
+      std::uint64_t data[3];
+      if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != sizeof(data))
+        continue;
+      double scale = data[2] > 0 ? static_cast<double>(data[1]) / data[2] : 0;
+      (*values)[i] = static_cast<long long>(data[0] * scale);
+    }
+  }
+
+ private:
+  std::array<int, Profiler::kCounterCount> fds_{-1, -1, -1, -1, -1, -1};
+  std::uint64_t vector_event_;
+
+  void Open(int counter, std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds_[counter] = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  }
+};
+
+const CounterSet& OwnCounterSet() {
+  thread_local std::unique_ptr<CounterSet> counters;
+  std::uint64_t vector_event = Profiler::Instance().GetVectorEvent();
+  if (!counters || counters->GetVectorEvent() != vector_event)
+    counters = std::make_unique<CounterSet>(vector_event);
+  return *counters;
+}
+
+void ReadOwnCounters(std::array<long long, Profiler::kCounterCount>* values) {
+  OwnCounterSet().Read(values);
+}
+
+bool AnyCounter() { return OwnCounterSet().Any(); }
+
+#else
+
+void ReadOwnCounters(std::array<long long, Profiler::kCounterCount>* values) {
+  values->fill(-1);
+}
+
+bool AnyCounter() { return false; }
+
+#endif
+
+// Counts of the parallel::For workers this thread started and joined
+thread_local std::array<long long, Profiler::kCounterCount> worker_counts{};
+
+void ReadCounters(std::array<long long, Profiler::kCounterCount>* values) {
+  ReadOwnCounters(values);
+  for (int i = 0; i < Profiler::kCounterCount; i++)
+    if ((*values)[i] >= 0) (*values)[i] += worker_counts[i];
+}
+
+}  // namespace
+
+Profiler& Profiler::Instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::Enable() noexcept { enabled_.store(true); }
+
+void Profiler::Disable() noexcept { enabled_.store(false); }
+
+bool Profiler::IsEnabled() const noexcept { return enabled_.load(); }
+
+bool Profiler::CountersAvailable() { return AnyCounter(); }
+
+void Profiler::SetVectorEvent(std::uint64_t raw_config) noexcept {
+  vector_event_.store(raw_config);
+}
+
+std::uint64_t Profiler::GetVectorEvent() const noexcept {
+  return vector_event_.load();
+}
+
+void Profiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+std::vector<Profiler::Entry> Profiler::GetEntries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> result;
+  result.reserve(entries_.size());
+  for (const auto& item : entries_) result.push_back(item.second);
+  return result;
+}
+
+void Profiler::Record(const char* operation, int rows, int cols,
+                      double seconds,
+                      const std::array<long long, kCounterCount>& counters) {
+  int rows_bucket = Bucket(rows), cols_bucket = Bucket(cols);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto key = std::make_tuple(std::string(operation), rows_bucket, cols_bucket);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    Entry entry{operation, rows_bucket, cols_bucket, 0, 0, counters};
+    it = entries_.emplace(key, entry).first;
+  } else {
+    for (int i = 0; i < kCounterCount; i++) {
+      long long& total = it->second.counters[i];
+      total = total < 0 || counters[i] < 0 ? -1 : total + counters[i];
+    }
+  }
+  it->second.calls++;
+  it->second.seconds += seconds;
+}
+
+const char* Profiler::CounterName(int counter) noexcept {
+  static const char* const kNames[kCounterCount] = {
+      "cycles",      "instructions",  "l1_misses",
+      "llc_misses",  "branch_misses", "vector_instructions"};
+  return counter >= 0 && counter < kCounterCount ? kNames[counter] : "";
+}
+
+std::string Profiler::ExportJson() const {
+  std::ostringstream out;
+  out.precision(9);
+  out << "[";
+  bool first = true;
+  for (const Entry& entry : GetEntries()) {
+    out << (first ? "\n" : ",\n") << "  {\"operation\": \"" << entry.operation
+        << "\", \"rows\": " << entry.rows_bucket
+        << ", \"cols\": " << entry.cols_bucket
+        << ", \"calls\": " << entry.calls
+        << ", \"seconds\": " << entry.seconds;
+    for (int i = 0; i < kCounterCount; i++) {
+      out << ", \"" << CounterName(i) << "\": ";
+      if (entry.counters[i] < 0) {
+        out << "null";
+      } else {
+        out << entry.counters[i];
+      }
+    }
+    out << "}";
+    first = false;
+  }
+  out << (first ? "]\n" : "\n]\n");
+  return out.str();
+}
+
+std::string Profiler::ExportCsv() const {
+  std::ostringstream out;
+  out.precision(9);
+  out << "operation,rows,cols,calls,seconds";
+  for (int i = 0; i < kCounterCount; i++) out << "," << CounterName(i);
+  out << "\n";
+  for (const Entry& entry : GetEntries()) {
+    out << entry.operation << "," << entry.rows_bucket << ","
+        << entry.cols_bucket << "," << entry.calls << "," << entry.seconds;
+    for (int i = 0; i < kCounterCount; i++) {
+      out << ",";
+      if (entry.counters[i] >= 0) out << entry.counters[i];
+    }
+    out << "\n";
+  }
+  return out.str();
+}
+
+ProfileScope::ProfileScope(const char* operation, int rows, int cols)
+    : operation_(operation),
+      rows_(rows),
+      cols_(cols),
+      active_(Profiler::Instance().IsEnabled()),
+      start_ns_(0) {
+  if (!active_) return;
+  ReadCounters(&start_);
+  start_ns_ = NowNs();
+}
+
+ProfileScope::~ProfileScope() {
+  if (!active_) return;
+  std::int64_t end_ns = NowNs();
+  std::array<long long, Profiler::kCounterCount> end;
+  ReadCounters(&end);
+  for (int i = 0; i < Profiler::kCounterCount; i++)
+    end[i] = end[i] < 0 || start_[i] < 0 ? -1 : end[i] - start_[i];
+  Profiler::Instance().Record(operation_, rows_, cols_,
+                              (end_ns - start_ns_) * 1e-9, end);
+}
+
+std::array<long long, Profiler::kCounterCount> ProfileScope::ThreadCounters() {
+  std::array<long long, Profiler::kCounterCount> result;
+  ReadCounters(&result);
+  return result;
+}
+
+void ProfileScope::CreditWorker(
+    const std::array<long long, Profiler::kCounterCount>& counts) {
+  for (int i = 0; i < Profiler::kCounterCount; i++)
+    if (counts[i] > 0) worker_counts[i] += counts[i];
+}
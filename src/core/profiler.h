@@ -0,0 +1,100 @@
+#ifndef SRC_CORE_PROFILER_H_
+#define SRC_CORE_PROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Opt-in profiling of the library kernels. While enabled, every kernel call
+// is timed and, where Linux perf_event_open is permitted, measured with
+// hardware counters. Results are aggregated per operation and shape bucket
+// (dimensions rounded up to a power of two, INT_MAX past 2^30). Counters
+// cover the calling thread and the pool workers running its parallel::For
+// ranges; each worker opens its counters once and keeps them. Where counters
+// cannot be opened, e.g. in containers, only call counts and wall time are
+// collected.
+class Profiler {
+ public:
+  enum Counter {
+    kCycles,
+    kInstructions,
+    kL1Misses,
+    kLlcMisses,
+    kBranchMisses,
+    kVectorInstructions,
+    kCounterCount
+  };
+
+  struct Entry {
+    std::string operation;
+    int rows_bucket, cols_bucket;
+    long long calls;
+    double seconds;
+    // Sums over all calls, -1 when the counter is unavailable
+    std::array<long long, kCounterCount> counters;
+  };
+
+  static Profiler& Instance();
+
+  void Enable() noexcept;
+  void Disable() noexcept;
+  bool IsEnabled() const noexcept;
+  // Checks whether at least one hardware counter can be opened here
+  bool CountersAvailable();
+  // There is no generic perf event for vector instructions; pass the raw
+  // PMU event of the host CPU (e.g. FP_ARITH_INST_RETIRED on Intel) to
+  // count them. Zero, the default, leaves the counter unavailable.
+  void SetVectorEvent(std::uint64_t raw_config) noexcept;
+  std::uint64_t GetVectorEvent() const noexcept;
+
+  void Reset();
+  std::vector<Entry> GetEntries() const;
+  std::string ExportJson() const;
+  std::string ExportCsv() const;
+
+  // Adds one measured call, used by ProfileScope
+  void Record(const char* operation, int rows, int cols, double seconds,
+              const std::array<long long, kCounterCount>& counters);
+
+  static const char* CounterName(int counter) noexcept;
+
+ private:
+  Profiler() = default;
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<std::uint64_t> vector_event_{0};
+  mutable std::mutex mutex_;
+  std::map<std::tuple<std::string, int, int>, Entry> entries_;
+};
+
+// Measures the enclosing block as one call of a kernel when profiling is
+// enabled, and costs a single atomic load when it is not
+class ProfileScope {
+ private:
+  const char* operation_;
+  int rows_, cols_;
+  bool active_;
+  std::int64_t start_ns_;
+  std::array<long long, Profiler::kCounterCount> start_;
+
+ public:
+  ProfileScope(const char* operation, int rows, int cols);
+  ~ProfileScope();
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  // Counters of the calling thread, including the workers credited to it.
+  // An inherited perf counter only receives a child's counts when the child
+  // exits, which may be after it was joined, so parallel::For workers read
+  // their own counters and the starting thread credits the difference.
+  static std::array<long long, Profiler::kCounterCount> ThreadCounters();
+  static void CreditWorker(
+      const std::array<long long, Profiler::kCounterCount>& counts);
+};
+
+#endif  // SRC_CORE_PROFILER_H_
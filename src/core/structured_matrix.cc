@@ -0,0 +1,743 @@
+#include "structured_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "parallel.h"
+
+namespace {
+
+void CheckSize(int size) {
+  if (size < 0) throw std::invalid_argument("Arguments less than zero");
+}
+
+void CheckIndex(int size, int row, int col) {
+  if (row < 0 || col < 0 || row >= size || col >= size)
+    throw std::out_of_range("Index is outside the matrix");
+}
+
+void CheckSquare(const Matrix& matrix) {
+  if (matrix.GetRows() != matrix.GetCols())
+    throw std::out_of_range("The matrix isn't square!");
+}
+
+void CheckProduct(int left_cols, int right_rows) {
+  if (left_cols != right_rows)
+    throw std::invalid_argument("Incorrect input, different size of matrices");
+}
+
+}  // namespace
+
+// TriangularMatrix
+
+TriangularMatrix::TriangularMatrix(int size, Triangle triangle)
+    : size_(size), triangle_(triangle) {
+  CheckSize(size);
+  data_.assign(static_cast<std::size_t>(size) * (size + 1) / 2, 0);
+}
+
+TriangularMatrix::TriangularMatrix(const Matrix& matrix, Triangle triangle)
+    : TriangularMatrix(matrix.GetRows(), triangle) {
+  CheckSquare(matrix);
+  for (int i = 0; i < size_; i++) {
+    const double* row = matrix.matrix_[i];
+    int begin = triangle_ == kLower ? 0 : i;
+    int end = triangle_ == kLower ? i + 1 : size_;
+    std::copy(row + begin, row + end, data_.begin() + Index(i, begin));
+  }
+}
+
+bool TriangularMatrix::Stored(int row, int col) const noexcept {
+  return triangle_ == kLower ? col <= row : col >= row;
+}
+
+std::size_t TriangularMatrix::Index(int row, int col) const noexcept {
+  std::size_t r = row;
+  if (triangle_ == kLower) return r * (r + 1) / 2 + col;
+  return r * (2 * static_cast<std::size_t>(size_) - r + 1) / 2 + (col - row);
+}
+
+int TriangularMatrix::GetSize() const noexcept { return size_; }
+
+TriangularMatrix::Triangle TriangularMatrix::GetTriangle() const noexcept {
+  return triangle_;
+}
+
+double& TriangularMatrix::operator()(int row, int col) {
+  CheckIndex(size_, row, col);
+  if (!Stored(row, col))
+    throw std::out_of_range("Index is outside the triangle");
+  return data_[Index(row, col)];
+}
+
+double TriangularMatrix::operator()(int row, int col) const {
+  CheckIndex(size_, row, col);
+  return Stored(row, col) ? data_[Index(row, col)] : 0;
+}
+
+double TriangularMatrix::Determinant() const noexcept {
+  double result = 1;
+  for (int i = 0; i < size_; i++) result *= data_[Index(i, i)];
+  return result;
+}
+
+Matrix TriangularMatrix::Solve(const Matrix& b) const {
+  CheckProduct(size_, b.rows_);
+  for (int i = 0; i < size_; i++)
+    if (data_[Index(i, i)] == 0)
+      throw std::invalid_argument(
+          "Incorrect input, matrix determinant is zero");
+  Matrix result(b);
+  int cols = b.cols_;
+  auto substitute = [&](int i) {
+    double* x = result.matrix_[i];
+    int begin = triangle_ == kLower ? 0 : i + 1;
+    int end = triangle_ == kLower ? i : size_;
+    const double* t = data_.data() + Index(i, begin);
+    for (int k = begin; k < end; k++, t++) {
+      const double* solved = result.matrix_[k];
+      for (int j = 0; j < cols; j++) x[j] -= *t * solved[j];
+    }
+    double diagonal = data_[Index(i, i)];
+    for (int j = 0; j < cols; j++) x[j] /= diagonal;
+  };
+  if (triangle_ == kLower) {
+    for (int i = 0; i < size_; i++) substitute(i);
+  } else {
+    for (int i = size_ - 1; i >= 0; i--) substitute(i);
+  }
+  return result;
+}
+
+Matrix TriangularMatrix::ToMatrix() const {
+  Matrix result(size_, size_);
+  for (int i = 0; i < size_; i++) {
+    int begin = triangle_ == kLower ? 0 : i;
+    int end = triangle_ == kLower ? i + 1 : size_;
+    std::copy(data_.begin() + Index(i, begin),
+              data_.begin() + Index(i, begin) + (end - begin),
+              result.matrix_[i] + begin);
+  }
+  return result;
+}
+
+TriangularMatrix::operator Matrix() const { return ToMatrix(); }
+
+Matrix operator*(const TriangularMatrix& left, const Matrix& right) {
+  CheckProduct(left.size_, right.rows_);
+  int n = left.size_, cols = right.cols_;
+  Matrix result(n, cols);
+  parallel::For(n, static_cast<std::size_t>(n) * cols / 2,
+                [&](int begin, int end) {
+                  for (int i = begin; i < end; i++) {
+                    bool lower = left.triangle_ == TriangularMatrix::kLower;
+                    int k_begin = lower ? 0 : i, k_end = lower ? i + 1 : n;
+                    const double* t =
+                        left.data_.data() + left.Index(i, k_begin);
+                    double* out = result.matrix_[i];
+                    for (int k = k_begin; k < k_end; k++, t++) {
+                      const double* row = right.matrix_[k];
+                      for (int j = 0; j < cols; j++) out[j] += *t * row[j];
+                    }
+                  }
+                });
+  return result;
+}
+
+Matrix operator*(const Matrix& left, const TriangularMatrix& right) {
+  CheckProduct(left.cols_, right.size_);
+  int n = right.size_, rows = left.rows_;
+  Matrix result(rows, n);
+  bool lower = right.triangle_ == TriangularMatrix::kLower;
+  parallel::For(rows, static_cast<std::size_t>(n) * n / 2,
+                [&](int begin, int end) {
+                  for (int r = begin; r < end; r++) {
+                    double* out = result.matrix_[r];
+                    for (int k = 0; k < n; k++) {
+                      double scale = left.matrix_[r][k];
+                      if (scale == 0) continue;
+                      int j_begin = lower ? 0 : k, j_end = lower ? k + 1 : n;
+                      const double* t =
+                          right.data_.data() + right.Index(k, j_begin);
+                      for (int j = j_begin; j < j_end; j++, t++)
+                        out[j] += scale * *t;
+                    }
+                  }
+                });
+  return result;
+}
+
+Matrix operator*(const TriangularMatrix& left, const TriangularMatrix& right) {
+  CheckProduct(left.size_, right.size_);
+  int n = left.size_;
+  Matrix result(n, n);
+  bool left_lower = left.triangle_ == TriangularMatrix::kLower;
+  bool right_lower = right.triangle_ == TriangularMatrix::kLower;
+  parallel::For(n, static_cast<std::size_t>(n) * n / 3,
+                [&](int begin, int end) {
+                  for (int i = begin; i < end; i++) {
+                    int k_begin = left_lower ? 0 : i;
+                    int k_end = left_lower ? i + 1 : n;
+                    const double* t =
+                        left.data_.data() + left.Index(i, k_begin);
+                    double* out = result.matrix_[i];
+                    for (int k = k_begin; k < k_end; k++, t++) {
+                      int j_begin = right_lower ? 0 : k;
+                      int j_end = right_lower ? k + 1 : n;
+                      const double* u =
+                          right.data_.data() + right.Index(k, j_begin);
+                      for (int j = j_begin; j < j_end; j++, u++)
+                        out[j] += *t * *u;
+                    }
+                  }
+                });
+  return result;
+}
+
+// SymmetricMatrix
+
+SymmetricMatrix::SymmetricMatrix(int size) : size_(size) {
+  CheckSize(size);
+  data_.assign(static_cast<std::size_t>(size) * (size + 1) / 2, 0);
+}
+
+SymmetricMatrix::SymmetricMatrix(const Matrix& matrix)
+    : SymmetricMatrix(matrix.GetRows()) {
+  CheckSquare(matrix);
+  for (int i = 0; i < size_; i++)
+    std::copy(matrix.matrix_[i], matrix.matrix_[i] + i + 1,
+              data_.begin() + Index(i, 0));
+}
+
+std::size_t SymmetricMatrix::Index(int row, int col) const noexcept {
+  if (col > row) std::swap(row, col);
+  std::size_t r = row;
+  return r * (r + 1) / 2 + col;
+}
+
+int SymmetricMatrix::GetSize() const noexcept { return size_; }
+
+double& SymmetricMatrix::operator()(int row, int col) {
+  CheckIndex(size_, row, col);
+  return data_[Index(row, col)];
+}
+
+double SymmetricMatrix::operator()(int row, int col) const {
+  CheckIndex(size_, row, col);
+  return data_[Index(row, col)];
+}
+
+SymmetricMatrix SymmetricMatrix::Gram(const Matrix& a) {
+  int m = a.rows_, n = a.cols_;
+  SymmetricMatrix result(n);
+  // Each thread owns a range of rows of the result, so no two threads write
+  // the same element
+  parallel::For(n, static_cast<std::size_t>(m) * n / 2, [&](int begin,
+                                                            int end) {
+    for (int r = 0; r < m; r++) {
+      const double* row = a.matrix_[r];
+      for (int i = begin; i < end; i++) {
+        double scale = row[i];
+        if (scale == 0) continue;
+        double* out = result.data_.data() + result.Index(i, 0);
+        for (int j = 0; j <= i; j++) out[j] += scale * row[j];
+      }
+    }
+  });
+  return result;
+}
+
+SymmetricMatrix::Factorization SymmetricMatrix::Factor() const {
+  int n = size_;
+  Factorization result{true, data_, {}, {}};
+  auto row = [&](int i) { return result.data.data() + Index(i, 0); };
+  // Packed Cholesky (as LAPACK dpptrf), one row of L at a time
+  for (int i = 0; i < n && result.cholesky; i++) {
+    double* row_i = row(i);
+    for (int j = 0; j <= i; j++) {
+      const double* row_j = row(j);
+      double value = row_i[j];
+      for (int p = 0; p < j; p++) value -= row_i[p] * row_j[p];
+      if (j < i) {
+        row_i[j] = value / row_j[j];
+      } else if (value > 0) {
+        row_i[i] = std::sqrt(value);
+      } else {
+        result.cholesky = false;
+      }
+    }
+  }
+  if (result.cholesky) return result;
+  // Bunch-Kaufman diagonal pivoting (as LAPACK dsptrf), right-looking
+  result.data = data_;
+  result.swaps.resize(n);
+  result.blocks.assign(n, 1);
+  auto at = [&](int i, int j) -> double& { return result.data[Index(i, j)]; };
+  const double alpha = (1 + std::sqrt(17.0)) / 8;
+  for (int k = 0; k < n;) {
+    double diagonal = std::fabs(at(k, k)), column_max = 0;
+    int largest = k;
+    for (int i = k + 1; i < n; i++)
+      if (std::fabs(at(i, k)) > column_max) {
+        column_max = std::fabs(at(i, k));
+        largest = i;
+      }
+    int pivot = k, step = 1;
+    if (diagonal < alpha * column_max) {
+      double row_max = 0;
+      for (int j = k; j < n; j++)
+        if (j != largest)
+          row_max = std::max(row_max, std::fabs(at(largest, j)));
+      if (diagonal * row_max < alpha * column_max * column_max) {
+        pivot = largest;
+        if (std::fabs(at(largest, largest)) < alpha * row_max) step = 2;
+      }
+    }
+    // Symmetric interchange of rows and columns, including the finished
+    // columns of L, so that a single permutation applies at the end
+    int target = k + step - 1;
+    result.swaps[k] = k;
+    result.swaps[target] = pivot;
+    if (pivot != target) {
+      for (int j = 0; j < n; j++)
+        if (j != target && j != pivot) std::swap(at(target, j), at(pivot, j));
+      std::swap(at(target, target), at(pivot, pivot));
+    }
+    // Rank-1 or rank-2 update of the trailing matrix with the original
+    // columns, which are then replaced by the columns of L
+    if (step == 1) {
+      double d = at(k, k);
+      if (d != 0) {
+        for (int i = k + 1; i < n; i++) {
+          double* row_i = row(i);
+          double factor = row_i[k] / d;
+          if (factor == 0) continue;
+          for (int j = k + 1; j <= i; j++) row_i[j] -= factor * row(j)[k];
+        }
+        for (int i = k + 1; i < n; i++) row(i)[k] /= d;
+      }
+    } else {
+      double d11 = at(k, k), d21 = at(k + 1, k), d22 = at(k + 1, k + 1);
+      double det = d11 * d22 - d21 * d21;
+      std::vector<std::pair<double, double>> w(n);
+      for (int i = k + 2; i < n; i++) {
+        double a1 = row(i)[k], a2 = row(i)[k + 1];
+        w[i] = {(a1 * d22 - a2 * d21) / det, (a2 * d11 - a1 * d21) / det};
+      }
+      for (int i = k + 2; i < n; i++) {
+        double* row_i = row(i);
+        for (int j = k + 2; j <= i; j++) {
+          const double* row_j = row(j);
+          row_i[j] -= w[i].first * row_j[k] + w[i].second * row_j[k + 1];
+        }
+      }
+      for (int i = k + 2; i < n; i++) {
+        row(i)[k] = w[i].first;
+        row(i)[k + 1] = w[i].second;
+      }
+      result.blocks[k] = 2;
+      result.blocks[k + 1] = 0;
+    }
+    k += step;
+  }
+  return result;
+}
+
+double SymmetricMatrix::Determinant() const {
+  Factorization factor = Factor();
+  auto at = [&](int i, int j) { return factor.data[Index(i, j)]; };
+  double result = 1;
+  for (int k = 0; k < size_; k++) {
+    if (factor.cholesky) {
+      result *= at(k, k) * at(k, k);
+    } else if (factor.blocks[k] == 1) {
+      result *= at(k, k);
+    } else if (factor.blocks[k] == 2) {
+      result *= at(k, k) * at(k + 1, k + 1) - at(k + 1, k) * at(k + 1, k);
+    }
+  }
+  return result;
+}
+
+Matrix SymmetricMatrix::Solve(const Matrix& b) const {
+  CheckProduct(size_, b.rows_);
+  Factorization factor = Factor();
+  int n = size_, cols = b.cols_;
+  Matrix x(b);
+  auto row = [&](int i) { return factor.data.data() + Index(i, 0); };
+  // (i, p) of L, which is zero inside a 2x2 block of D
+  auto in_l = [&](int i, int p) {
+    return factor.cholesky || factor.blocks[p] != 2 || i != p + 1;
+  };
+  auto subtract = [&](int target, int source, double scale) {
+    if (scale == 0) return;
+    double* out = x.matrix_[target];
+    const double* in = x.matrix_[source];
+    for (int j = 0; j < cols; j++) out[j] -= scale * in[j];
+  };
+  auto divide = [&](int target, double value) {
+    double* out = x.matrix_[target];
+    for (int j = 0; j < cols; j++) out[j] /= value;
+  };
+  if (!factor.cholesky) {
+    for (int k = 0; k < n; k++) {
+      int block = factor.blocks[k];
+      double d = row(k)[k];
+      double d21 = block == 2 ? row(k + 1)[k] : 0;
+      if ((block == 1 && d == 0) ||
+          (block == 2 && d * row(k + 1)[k + 1] == d21 * d21))
+        throw std::invalid_argument(
+            "Incorrect input, matrix determinant is zero");
+    }
+    for (int k = 0; k < n; k++)
+      if (factor.swaps[k] != k)
+        std::swap_ranges(x.matrix_[k], x.matrix_[k] + cols,
+                         x.matrix_[factor.swaps[k]]);
+  }
+  // L * Y = P * B
+  for (int i = 0; i < n; i++) {
+    const double* l = row(i);
+    for (int p = 0; p < i; p++)
+      if (in_l(i, p)) subtract(i, p, l[p]);
+    if (factor.cholesky) divide(i, l[i]);
+  }
+  // D * Z = Y
+  for (int k = 0; !factor.cholesky && k < n; k++) {
+    if (factor.blocks[k] == 1) {
+      divide(k, row(k)[k]);
+    } else if (factor.blocks[k] == 2) {
+      double d11 = row(k)[k], d21 = row(k + 1)[k], d22 = row(k + 1)[k + 1];
+      double det = d11 * d22 - d21 * d21;
+      double* first = x.matrix_[k];
+      double* second = x.matrix_[k + 1];
+      for (int j = 0; j < cols; j++) {
+        double y1 = first[j], y2 = second[j];
+        first[j] = (d22 * y1 - d21 * y2) / det;
+        second[j] = (d11 * y2 - d21 * y1) / det;
+      }
+    }
+  }
+  // L^T * W = Z, using the rows of L as columns of L^T
+  for (int p = n - 1; p >= 0; p--) {
+    const double* l = row(p);
+    if (factor.cholesky) divide(p, l[p]);
+    for (int i = 0; i < p; i++)
+      if (in_l(p, i)) subtract(i, p, l[i]);
+  }
+  if (!factor.cholesky)
+    for (int k = n - 1; k >= 0; k--)
+      if (factor.swaps[k] != k)
+        std::swap_ranges(x.matrix_[k], x.matrix_[k] + cols,
+                         x.matrix_[factor.swaps[k]]);
+  return x;
+}
+
+Matrix SymmetricMatrix::ToMatrix() const {
+  Matrix result(size_, size_);
+  for (int i = 0; i < size_; i++) {
+    const double* row = data_.data() + Index(i, 0);
+    for (int j = 0; j <= i; j++)
+      result.matrix_[i][j] = result.matrix_[j][i] = row[j];
+  }
+  return result;
+}
+
+SymmetricMatrix::operator Matrix() const { return ToMatrix(); }
+
+Matrix operator*(const SymmetricMatrix& left, const Matrix& right) {
+  CheckProduct(left.size_, right.rows_);
+  int n = left.size_, cols = right.cols_;
+  Matrix result(n, cols);
+  // Every stored S[i][k] (k < i) contributes to rows i and k of the result
+  for (int i = 0; i < n; i++) {
+    const double* s = left.data_.data() + left.Index(i, 0);
+    const double* row_i = right.matrix_[i];
+    double* out_i = result.matrix_[i];
+    for (int k = 0; k < i; k++) {
+      double value = s[k];
+      if (value == 0) continue;
+      const double* row_k = right.matrix_[k];
+      double* out_k = result.matrix_[k];
+      for (int j = 0; j < cols; j++) {
+        out_i[j] += value * row_k[j];
+        out_k[j] += value * row_i[j];
+      }
+    }
+    double diagonal = s[i];
+    for (int j = 0; j < cols; j++) out_i[j] += diagonal * row_i[j];
+  }
+  return result;
+}
+
+Matrix operator*(const Matrix& left, const SymmetricMatrix& right) {
+  // (A * S)^T = S * A^T
+  return (right * left.Transpose()).Transpose();
+}
+
+// DiagonalMatrix
+
+DiagonalMatrix::DiagonalMatrix(int size) {
+  CheckSize(size);
+  data_.assign(size, 0);
+}
+
+DiagonalMatrix::DiagonalMatrix(const std::vector<double>& diagonal)
+    : data_(diagonal) {}
+
+int DiagonalMatrix::GetSize() const noexcept {
+  return static_cast<int>(data_.size());
+}
+
+double& DiagonalMatrix::operator()(int row, int col) {
+  CheckIndex(GetSize(), row, col);
+  if (row != col) throw std::out_of_range("Index is outside the diagonal");
+  return data_[row];
+}
+
+double DiagonalMatrix::operator()(int row, int col) const {
+  CheckIndex(GetSize(), row, col);
+  return row == col ? data_[row] : 0;
+}
+
+double DiagonalMatrix::Determinant() const noexcept {
+  double result = 1;
+  for (double value : data_) result *= value;
+  return result;
+}
+
+Matrix DiagonalMatrix::Solve(const Matrix& b) const {
+  return Inverse() * b;
+}
+
+DiagonalMatrix DiagonalMatrix::Inverse() const {
+  DiagonalMatrix result(GetSize());
+  for (int i = 0; i < GetSize(); i++) {
+    if (data_[i] == 0)
+      throw std::invalid_argument(
+          "Incorrect input, matrix determinant is zero");
+    result.data_[i] = 1 / data_[i];
+  }
+  return result;
+}
+
+Matrix DiagonalMatrix::ToMatrix() const {
+  Matrix result(GetSize(), GetSize());
+  for (int i = 0; i < GetSize(); i++) result.matrix_[i][i] = data_[i];
+  return result;
+}
+
+DiagonalMatrix::operator Matrix() const { return ToMatrix(); }
+
+Matrix operator*(const DiagonalMatrix& left, const Matrix& right) {
+  CheckProduct(left.GetSize(), right.rows_);
+  Matrix result(right.rows_, right.cols_);
+  for (int i = 0; i < right.rows_; i++)
+    for (int j = 0; j < right.cols_; j++)
+      result.matrix_[i][j] = left.data_[i] * right.matrix_[i][j];
+  return result;
+}
+
+Matrix operator*(const Matrix& left, const DiagonalMatrix& right) {
+  CheckProduct(left.cols_, right.GetSize());
+  Matrix result(left.rows_, left.cols_);
+  for (int i = 0; i < left.rows_; i++)
+    for (int j = 0; j < left.cols_; j++)
+      result.matrix_[i][j] = left.matrix_[i][j] * right.data_[j];
+  return result;
+}
+
+DiagonalMatrix operator*(const DiagonalMatrix& left,
+                         const DiagonalMatrix& right) {
+  CheckProduct(left.GetSize(), right.GetSize());
+  DiagonalMatrix result(left.data_);
+  for (std::size_t i = 0; i < result.data_.size(); i++)
+    result.data_[i] *= right.data_[i];
+  return result;
+}
+
+// BandMatrix
+
+BandMatrix::BandMatrix(int size, int lower, int upper)
+    : size_(size), lower_(lower), upper_(upper) {
+  CheckSize(size);
+  if (lower < 0 || upper < 0)
+    throw std::invalid_argument("Arguments less than zero");
+  data_.assign(static_cast<std::size_t>(size) * (lower + upper + 1), 0);
+}
+
+BandMatrix::BandMatrix(const Matrix& matrix, int lower, int upper)
+    : BandMatrix(matrix.GetRows(), lower, upper) {
+  CheckSquare(matrix);
+  for (int i = 0; i < size_; i++)
+    for (int j = std::max(0, i - lower_); j <= std::min(size_ - 1, i + upper_);
+         j++)
+      data_[Index(i, j)] = matrix.matrix_[i][j];
+}
+
+bool BandMatrix::Stored(int row, int col) const noexcept {
+  return col - row >= -lower_ && col - row <= upper_;
+}
+
+std::size_t BandMatrix::Index(int row, int col) const noexcept {
+  return static_cast<std::size_t>(row) * (lower_ + upper_ + 1) +
+         (col - row + lower_);
+}
+
+int BandMatrix::GetSize() const noexcept { return size_; }
+
+int BandMatrix::GetLower() const noexcept { return lower_; }
+
+int BandMatrix::GetUpper() const noexcept { return upper_; }
+
+double& BandMatrix::operator()(int row, int col) {
+  CheckIndex(size_, row, col);
+  if (!Stored(row, col)) throw std::out_of_range("Index is outside the band");
+  return data_[Index(row, col)];
+}
+
+double BandMatrix::operator()(int row, int col) const {
+  CheckIndex(size_, row, col);
+  return Stored(row, col) ? data_[Index(row, col)] : 0;
+}
+
+bool BandMatrix::Eliminate(std::vector<double>* factor, Matrix* rhs,
+                           double* determinant) const {
+  // Row pivoting can move a row up by at most `lower`, so its nonzeros then
+  // reach `lower + upper` past the diagonal. Work rows hold columns
+  // i - lower .. i + lower + upper at offset col - i + lower.
+  int n = size_, kl = lower_, width = 2 * lower_ + upper_ + 1;
+  std::vector<double>& work = *factor;
+  work.assign(static_cast<std::size_t>(n) * width, 0);
+  auto at = [&](int row, int col) -> double& {
+    return work[static_cast<std::size_t>(row) * width + (col - row + kl)];
+  };
+  std::vector<double> tolerance(n, 0);
+  for (int i = 0; i < n; i++)
+    for (int j = std::max(0, i - kl); j <= std::min(n - 1, i + upper_); j++) {
+      at(i, j) = data_[Index(i, j)];
+      tolerance[j] = std::max(tolerance[j], std::fabs(at(i, j)));
+    }
+  for (double& value : tolerance)
+    value *= n * std::numeric_limits<double>::epsilon();
+  *determinant = 1;
+  for (int k = 0; k < n; k++) {
+    int last_row = std::min(n - 1, k + kl);
+    int last_col = std::min(n - 1, k + kl + upper_);
+    int pivot = k;
+    for (int i = k + 1; i <= last_row; i++)
+      if (std::fabs(at(i, k)) > std::fabs(at(pivot, k))) pivot = i;
+    if (std::fabs(at(pivot, k)) <= tolerance[k]) {
+      *determinant = 0;
+      return false;
+    }
+    if (pivot != k) {
+      for (int j = k; j <= last_col; j++) std::swap(at(k, j), at(pivot, j));
+      if (rhs)
+        std::swap_ranges(rhs->matrix_[k], rhs->matrix_[k] + rhs->cols_,
+                         rhs->matrix_[pivot]);
+      *determinant = -*determinant;
+    }
+    double diagonal = at(k, k);
+    *determinant *= diagonal;
+    for (int i = k + 1; i <= last_row; i++) {
+      double factor_ik = at(i, k) / diagonal;
+      if (factor_ik == 0) continue;
+      for (int j = k + 1; j <= last_col; j++) at(i, j) -= factor_ik * at(k, j);
+      if (rhs) {
+        const double* source = rhs->matrix_[k];
+        double* target = rhs->matrix_[i];
+        for (int j = 0; j < rhs->cols_; j++) target[j] -= factor_ik * source[j];
+      }
+    }
+  }
+  return true;
+}
+
+double BandMatrix::Determinant() const {
+  std::vector<double> factor;
+  double determinant = 0;
+  Eliminate(&factor, nullptr, &determinant);
+  return determinant;
+}
+
+Matrix BandMatrix::Solve(const Matrix& b) const {
+  CheckProduct(size_, b.rows_);
+  Matrix x(b);
+  std::vector<double> factor;
+  double determinant = 0;
+  if (!Eliminate(&factor, &x, &determinant))
+    throw std::invalid_argument("Incorrect input, matrix determinant is zero");
+  int n = size_, kl = lower_, width = 2 * lower_ + upper_ + 1;
+  auto at = [&](int row, int col) {
+    return factor[static_cast<std::size_t>(row) * width + (col - row + kl)];
+  };
+  for (int i = n - 1; i >= 0; i--) {
+    double* row = x.matrix_[i];
+    for (int k = i + 1; k <= std::min(n - 1, i + kl + upper_); k++) {
+      double value = at(i, k);
+      if (value == 0) continue;
+      const double* solved = x.matrix_[k];
+      for (int j = 0; j < x.cols_; j++) row[j] -= value * solved[j];
+    }
+    double diagonal = at(i, i);
+    for (int j = 0; j < x.cols_; j++) row[j] /= diagonal;
+  }
+  return x;
+}
+
+Matrix BandMatrix::ToMatrix() const {
+  Matrix result(size_, size_);
+  for (int i = 0; i < size_; i++)
+    for (int j = std::max(0, i - lower_); j <= std::min(size_ - 1, i + upper_);
+         j++)
+      result.matrix_[i][j] = data_[Index(i, j)];
+  return result;
+}
+
+BandMatrix::operator Matrix() const { return ToMatrix(); }
+
+Matrix operator*(const BandMatrix& left, const Matrix& right) {
+  CheckProduct(left.size_, right.rows_);
+  int n = left.size_, cols = right.cols_;
+  Matrix result(n, cols);
+  parallel::For(
+      n, static_cast<std::size_t>(left.lower_ + left.upper_ + 1) * cols,
+      [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          double* out = result.matrix_[i];
+          for (int k = std::max(0, i - left.lower_);
+               k <= std::min(n - 1, i + left.upper_); k++) {
+            double value = left.data_[left.Index(i, k)];
+            if (value == 0) continue;
+            const double* row = right.matrix_[k];
+            for (int j = 0; j < cols; j++) out[j] += value * row[j];
+          }
+        }
+      });
+  return result;
+}
+
+Matrix operator*(const Matrix& left, const BandMatrix& right) {
+  CheckProduct(left.cols_, right.size_);
+  int n = right.size_, rows = left.rows_;
+  Matrix result(rows, n);
+  parallel::For(
+      rows, static_cast<std::size_t>(right.lower_ + right.upper_ + 1) * n,
+      [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          const double* row = left.matrix_[i];
+          double* out = result.matrix_[i];
+          for (int k = 0; k < n; k++) {
+            double value = row[k];
+            if (value == 0) continue;
+            for (int j = std::max(0, k - right.lower_);
+                 j <= std::min(n - 1, k + right.upper_); j++)
+              out[j] += value * right.data_[right.Index(k, j)];
+          }
+        }
+      });
+  return result;
+}
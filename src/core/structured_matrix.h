@@ -0,0 +1,186 @@
+#ifndef SRC_CORE_STRUCTURED_MATRIX_H_
+#define SRC_CORE_STRUCTURED_MATRIX_H_
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Square matrices with a known zero or symmetry pattern. Only the entries the
+// pattern allows are stored, and the kernels skip the rest. All of them
+// convert to a dense Matrix, so they can be used with the Matrix operators,
+// and multiply with a Matrix, or with one another, without converting the
+// left operand.
+//
+// The mutable operator() throws std::out_of_range for entries outside the
+// pattern, which are always zero.
+
+// Lower or upper triangular matrix in packed row storage
+class TriangularMatrix {
+ public:
+  enum Triangle { kLower, kUpper };
+
+ private:
+  int size_;
+  Triangle triangle_;
+  std::vector<double> data_;
+
+  bool Stored(int row, int col) const noexcept;
+  std::size_t Index(int row, int col) const noexcept;
+
+ public:
+  TriangularMatrix(int size, Triangle triangle);
+  // Takes one triangle of a square matrix, the other one is dropped
+  TriangularMatrix(const Matrix& matrix, Triangle triangle);
+
+  int GetSize() const noexcept;
+  Triangle GetTriangle() const noexcept;
+  double& operator()(int row, int col);
+  double operator()(int row, int col) const;
+
+  // Product of the diagonal, O(n)
+  double Determinant() const noexcept;
+  // Solves T * X = B by substitution, O(n^2) per column
+  Matrix Solve(const Matrix& b) const;
+  Matrix ToMatrix() const;
+  operator Matrix() const;
+
+  // Triangular times dense, half the flops of a general product
+  friend Matrix operator*(const TriangularMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const TriangularMatrix& right);
+  // Visits only the pairs of stored entries; with the same triangle on both
+  // sides the product stays triangular and only that triangle is computed
+  friend Matrix operator*(const TriangularMatrix& left,
+                          const TriangularMatrix& right);
+};
+
+// Symmetric matrix storing only its lower triangle, packed by rows
+class SymmetricMatrix {
+ private:
+  int size_;
+  std::vector<double> data_;
+
+  // Factorization in the packed layout of data_: the Cholesky factor L when
+  // the matrix is positive definite, otherwise Bunch-Kaufman
+  // P * A * P^T = L * D * L^T with 1x1 and 2x2 diagonal blocks in D
+  struct Factorization {
+    bool cholesky;
+    std::vector<double> data;
+    // Row swapped with row k at step k
+    std::vector<int> swaps;
+    // 2 where a 2x2 block of D starts, 0 on its second row, 1 otherwise
+    std::vector<int> blocks;
+  };
+
+  std::size_t Index(int row, int col) const noexcept;
+  Factorization Factor() const;
+
+ public:
+  explicit SymmetricMatrix(int size);
+  // Takes the lower triangle of a square matrix
+  explicit SymmetricMatrix(const Matrix& matrix);
+
+  int GetSize() const noexcept;
+  // (row, col) and (col, row) refer to the same element
+  double& operator()(int row, int col);
+  double operator()(int row, int col) const;
+
+  // A^T * A, computing only the lower triangle (SYRK)
+  static SymmetricMatrix Gram(const Matrix& a);
+
+  // Factor in packed storage, O(n^3 / 3) without expanding the matrix
+  double Determinant() const;
+  // Throws when a block of D is exactly singular
+  Matrix Solve(const Matrix& b) const;
+  Matrix ToMatrix() const;
+  operator Matrix() const;
+
+  // Symmetric times dense reading every stored element once (SYMM)
+  friend Matrix operator*(const SymmetricMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const SymmetricMatrix& right);
+};
+
+class DiagonalMatrix {
+ private:
+  std::vector<double> data_;
+
+ public:
+  explicit DiagonalMatrix(int size);
+  explicit DiagonalMatrix(const std::vector<double>& diagonal);
+
+  int GetSize() const noexcept;
+  double& operator()(int row, int col);
+  double operator()(int row, int col) const;
+
+  double Determinant() const noexcept;
+  Matrix Solve(const Matrix& b) const;
+  DiagonalMatrix Inverse() const;
+  Matrix ToMatrix() const;
+  operator Matrix() const;
+
+  // Scales the rows or the columns of the dense matrix
+  friend Matrix operator*(const DiagonalMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const DiagonalMatrix& right);
+  friend DiagonalMatrix operator*(const DiagonalMatrix& left,
+                                  const DiagonalMatrix& right);
+};
+
+// Matrix with `lower` subdiagonals and `upper` superdiagonals, stored as one
+// row of lower + upper + 1 entries per matrix row
+class BandMatrix {
+ private:
+  int size_, lower_, upper_;
+  std::vector<double> data_;
+
+  bool Stored(int row, int col) const noexcept;
+  std::size_t Index(int row, int col) const noexcept;
+  // Gaussian elimination with partial pivoting inside the band, applied to
+  // rhs as well. Leaves the upper factor, whose bandwidth grows to
+  // lower + upper, in *factor and the determinant in *determinant. Returns
+  // false, with a zero determinant, once a pivot is no larger than
+  // n * epsilon times the largest entry of its column.
+  bool Eliminate(std::vector<double>* factor, Matrix* rhs,
+                 double* determinant) const;
+
+ public:
+  BandMatrix(int size, int lower, int upper);
+  // Takes the band of a square matrix
+  BandMatrix(const Matrix& matrix, int lower, int upper);
+
+  int GetSize() const noexcept;
+  int GetLower() const noexcept;
+  int GetUpper() const noexcept;
+  double& operator()(int row, int col);
+  double operator()(int row, int col) const;
+
+  // O(n * lower * (lower + upper))
+  double Determinant() const;
+  // O(n * lower * (lower + upper)) plus O(n * (lower + upper)) per column
+  Matrix Solve(const Matrix& b) const;
+  Matrix ToMatrix() const;
+  operator Matrix() const;
+
+  friend Matrix operator*(const BandMatrix& left, const Matrix& right);
+  friend Matrix operator*(const Matrix& left, const BandMatrix& right);
+};
+
+template <class T>
+struct IsStructuredMatrix
+    : std::bool_constant<std::is_same_v<T, TriangularMatrix> ||
+                         std::is_same_v<T, SymmetricMatrix> ||
+                         std::is_same_v<T, DiagonalMatrix> ||
+                         std::is_same_v<T, BandMatrix>> {};
+
+// Remaining products of two structured matrices, which would otherwise be
+// ambiguous between the overloads taking one dense side: the right operand
+// is expanded and the left one keeps its structured kernel
+template <class Left, class Right,
+          std::enable_if_t<IsStructuredMatrix<Left>::value &&
+                               IsStructuredMatrix<Right>::value,
+                           int> = 0>
+Matrix operator*(const Left& left, const Right& right) {
+  return left * right.ToMatrix();
+}
+
+#endif  // SRC_CORE_STRUCTURED_MATRIX_H_
@@ -1,6 +1,22 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "../core/allocation.h"
+#include "../core/async.h"
+#include "../core/factorization.h"
+#include "../core/low_rank_update.h"
+#include "../core/matrix_io.h"
 #include "../core/matrix_oop.h"
+#include "../core/parallel.h"
+#include "../core/profiler.h"
+#include "../core/structured_matrix.h"
 
 TEST(test, defaultConstructor) {
   Matrix basic;
@@ -546,6 +562,711 @@ TEST(test, plus_Exception3) {
   EXPECT_ANY_THROW(a.SumMatrix(b));
 }
 
+TEST(parallel, elementwiseLarge) {
+  int threads = parallel::ThreadCount();
+  std::size_t serial = parallel::SerialThreshold();
+  std::size_t streaming = parallel::StreamingThreshold();
+  parallel::SetThreadCount(4);
+  parallel::SetSerialThreshold(16);
+  parallel::SetStreamingThreshold(0);
+  Matrix a(37, 29);
+  Matrix b(37, 29);
+  for (int i = 0; i < a.GetRows(); i++)
+    for (int j = 0; j < a.GetCols(); j++) {
+      a(i, j) = i * 100 + j;
+      b(i, j) = j - i;
+    }
+  Matrix sum = a + b;
+  Matrix diff = a - b;
+  Matrix scaled = 0.5 * a;
+  Matrix copy(a);
+  a += b;
+  EXPECT_TRUE(a == sum);
+  a -= b;
+  a -= b;
+  EXPECT_TRUE(a == diff);
+  a += b;
+  a *= 0.5;
+  EXPECT_TRUE(a == scaled);
+  EXPECT_DOUBLE_EQ(copy(36, 28), 3628);
+  EXPECT_DOUBLE_EQ(sum(36, 28), 3620);
+  EXPECT_DOUBLE_EQ(diff(5, 3), 505);
+  parallel::SetThreadCount(threads);
+  parallel::SetSerialThreshold(serial);
+  parallel::SetStreamingThreshold(streaming);
+}
+
+TEST(parallel, threadCountException) {
+  EXPECT_ANY_THROW(parallel::SetThreadCount(0));
+}
+
+TEST(parallel, workerExceptionsReachTheCaller) {
+  int threads = parallel::ThreadCount();
+  std::size_t threshold = parallel::SerialThreshold();
+  parallel::SetThreadCount(4);
+  parallel::SetSerialThreshold(1);
+  EXPECT_THROW(parallel::For(4, 1000,
+                             [](int begin, int) {
+                               if (begin > 0) throw std::runtime_error("");
+                             }),
+               std::runtime_error);
+  std::atomic<int> total{0};
+  parallel::For(100, 1000, [&total](int begin, int end) {
+    total += end - begin;
+  });
+  EXPECT_EQ(total, 100);
+  parallel::SetSerialThreshold(threshold);
+  parallel::SetThreadCount(threads);
+}
+
+static Matrix FillMatrix(int rows, int cols, unsigned seed) {
+  Matrix result(rows, cols);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++) {
+      seed = seed * 1103515245 + 12345;
+      result(i, j) = static_cast<double>((seed >> 16) % 2001) / 1000.0 - 1.0;
+    }
+  return result;
+}
+
+static Matrix Identity(int size) {
+  Matrix result(size, size);
+  for (int i = 0; i < size; i++) result(i, i) = 1;
+  return result;
+}
+
+TEST(factorization, luSolve) {
+  Matrix a = FillMatrix(150, 150, 1);
+  Matrix b = FillMatrix(150, 3, 2);
+  LUFactorization lu(a);
+  EXPECT_FALSE(lu.IsSingular());
+  Matrix x = lu.Solve(b);
+  EXPECT_TRUE(a * x == b);
+  EXPECT_TRUE(a * lu.Inverse() == Identity(150));
+}
+
+TEST(factorization, luDeterminant) {
+  Matrix a = FillMatrix(6, 6, 3);
+  double expected = 0;
+  for (int i = 0; i < 6; i++) {
+    Matrix minor(5, 5);
+    for (int r = 1; r < 6; r++)
+      for (int c = 0, m = 0; c < 6; c++)
+        if (c != i) minor(r - 1, m++) = a(r, c);
+    expected += (i % 2 ? -1 : 1) * a(0, i) * minor.Determinant();
+  }
+  EXPECT_NEAR(LUFactorization(a).Determinant(), expected, 1e-12);
+  EXPECT_NEAR(a.Determinant(), expected, 1e-12);
+}
+
+TEST(factorization, cholesky) {
+  Matrix m = FillMatrix(130, 130, 4);
+  Matrix a = m * m.Transpose() + 130 * Identity(130);
+  Matrix b = FillMatrix(130, 2, 5);
+  CholeskyFactorization cholesky(a);
+  Matrix l = cholesky.GetL();
+  EXPECT_TRUE(l * l.Transpose() == a);
+  EXPECT_TRUE(a * cholesky.Solve(b) == b);
+  EXPECT_TRUE(a * cholesky.Inverse() == Identity(130));
+  EXPECT_NEAR(cholesky.Determinant() / LUFactorization(a).Determinant(), 1,
+              1e-9);
+}
+
+TEST(factorization, qrSquare) {
+  Matrix a = FillMatrix(100, 100, 6);
+  QRFactorization qr(a);
+  Matrix b = FillMatrix(100, 2, 7);
+  EXPECT_TRUE(a * qr.Solve(b) == b);
+  EXPECT_TRUE(a * qr.Inverse() == Identity(100));
+  EXPECT_NEAR(qr.Determinant() / LUFactorization(a).Determinant(), 1, 1e-9);
+}
+
+TEST(factorization, qrLeastSquares) {
+  Matrix a = FillMatrix(200, 90, 8);
+  Matrix b = FillMatrix(200, 1, 9);
+  Matrix x = QRFactorization(a).LeastSquares(b);
+  // The residual of a least squares solution is orthogonal to range(A)
+  Matrix normal = a.Transpose() * (a * x - b);
+  EXPECT_TRUE(normal == Matrix(90, 1));
+  Matrix r = QRFactorization(a).GetR();
+  EXPECT_TRUE(r.Transpose() * r == a.Transpose() * a);
+}
+
+TEST(factorization, exceptions) {
+  Matrix singular(3, 3);
+  singular(0, 0) = 1;
+  singular(1, 1) = 1;
+  EXPECT_TRUE(LUFactorization(singular).IsSingular());
+  EXPECT_EQ(LUFactorization(singular).Determinant(), 0);
+  EXPECT_ANY_THROW(LUFactorization(singular).Solve(Matrix(3, 1)));
+  EXPECT_ANY_THROW(LUFactorization lu(Matrix(2, 3)));
+  EXPECT_ANY_THROW(CholeskyFactorization cholesky(singular));
+  EXPECT_ANY_THROW(CholeskyFactorization(FillMatrix(4, 4, 10)));
+  EXPECT_ANY_THROW(QRFactorization qr(Matrix(2, 3)));
+  EXPECT_ANY_THROW(QRFactorization(singular).Solve(Matrix(3, 1)));
+  EXPECT_ANY_THROW(QRFactorization(Matrix(4, 3)).Determinant());
+}
+
+TEST(factorization, luBadlyScaled) {
+  Matrix scaled(3, 3);
+  scaled(0, 0) = 1e10;
+  scaled(1, 1) = 1;
+  scaled(2, 2) = 1e-8;
+  EXPECT_FALSE(LUFactorization(scaled).IsSingular());
+  EXPECT_DOUBLE_EQ(scaled.Determinant(), 100);
+  EXPECT_DOUBLE_EQ(scaled.InverseMatrix()(2, 2), 1e8);
+  Matrix hilbert(13, 13);
+  for (int i = 0; i < 13; i++)
+    for (int j = 0; j < 13; j++) hilbert(i, j) = 1.0 / (i + j + 1);
+  EXPECT_GT(hilbert.Determinant(), 0);
+  EXPECT_NO_THROW(hilbert.InverseMatrix());
+}
+
+TEST(product, optimalOrder) {
+  Matrix a1(30, 35), a2(35, 15), a3(15, 5), a4(5, 10), a5(10, 20), a6(20, 25);
+  MatrixProduct chain = a1 * a2 * a3 * a4 * a5 * a6;
+  EXPECT_EQ(chain.GetLength(), 6);
+  EXPECT_EQ(chain.GetRows(), 30);
+  EXPECT_EQ(chain.GetCols(), 25);
+  EXPECT_DOUBLE_EQ(chain.Cost(), 15125);
+}
+
+TEST(product, matchesEagerProduct) {
+  Matrix a = FillMatrix(40, 30, 11);
+  Matrix b = FillMatrix(30, 50, 12);
+  Matrix c = FillMatrix(50, 20, 13);
+  Matrix v = FillMatrix(20, 1, 14);
+  Matrix expected(a);
+  expected.MulMatrix(b);
+  expected.MulMatrix(c);
+  expected.MulMatrix(v);
+  expected.MulNumber(2);
+  Matrix result = 2 * (a * b) * (c * v);
+  EXPECT_TRUE(result == expected);
+  EXPECT_EQ(result.GetRows(), 40);
+  EXPECT_EQ(result.GetCols(), 1);
+}
+
+TEST(product, temporariesAndAssignment) {
+  Matrix a = FillMatrix(5, 5, 15);
+  Matrix b = FillMatrix(5, 5, 16);
+  Matrix sum = a + b;
+  Matrix expected(sum);
+  expected.MulMatrix(a);
+  MatrixProduct chain = (a + b) * a;
+  EXPECT_TRUE(chain.Evaluate() == expected);
+  Matrix result(5, 5);
+  result = chain;
+  EXPECT_TRUE(result == expected);
+  expected = sum;
+  expected.MulMatrix(result);
+  result = sum * result;
+  EXPECT_TRUE(result == expected);
+}
+
+TEST(product, baselineMatrixInterface) {
+  Matrix a = FillMatrix(6, 6, 49), b = FillMatrix(6, 6, 50);
+  Matrix c(a);
+  c.MulMatrix(b);
+  EXPECT_EQ((a * b)(2, 3), c(2, 3));
+  EXPECT_TRUE((a * b).EqMatrix(c));
+  EXPECT_TRUE((a * b).Transpose() == c.Transpose());
+  EXPECT_NEAR((a * b).Determinant() / c.Determinant(), 1, 1e-9);
+  EXPECT_TRUE((a * b).InverseMatrix() == c.InverseMatrix());
+  EXPECT_TRUE((a * b).Power(2) == c * c);
+  EXPECT_TRUE(a * b + c == 2 * c);
+  EXPECT_TRUE(a * b == c);
+}
+
+TEST(product, namedOperandsOnlyNeedToOutliveTheProduct) {
+  Matrix a = FillMatrix(4, 5, 51), b = FillMatrix(5, 3, 52);
+  // The temporary is owned by the product, a and b are referenced
+  auto p = a * b * Identity(3);
+  Matrix expected(a);
+  expected.MulMatrix(b);
+  EXPECT_TRUE(Matrix(p) == expected);
+  a(0, 0) += 1;
+  expected = a;
+  expected.MulMatrix(b);
+  EXPECT_TRUE(p.Evaluate() == expected);
+  auto q = p * 2.0;
+  EXPECT_TRUE(Matrix(q) == 2 * expected);
+}
+
+TEST(product, exception) {
+  Matrix a(2, 3), b(3, 4), c(2, 2);
+  EXPECT_ANY_THROW(Matrix result = a * b * c);
+}
+
+TEST(mixedPrecision, wellConditioned) {
+  Matrix a = FillMatrix(120, 120, 17) + 60 * Identity(120);
+  Matrix b = FillMatrix(120, 2, 18);
+  MixedPrecisionSolver solver(a);
+  RefinementStats stats;
+  Matrix x = solver.Solve(b, &stats);
+  EXPECT_TRUE(stats.converged);
+  EXPECT_FALSE(stats.fell_back);
+  EXPECT_FALSE(solver.UsesFallback());
+  EXPECT_GT(stats.iterations, 1);
+  EXPECT_LT(stats.residual, 1e-15);
+  Matrix expected = LUFactorization(a).Solve(b);
+  for (int i = 0; i < 120; i++) EXPECT_NEAR(x(i, 1), expected(i, 1), 1e-13);
+}
+
+TEST(mixedPrecision, illConditionedFallsBack) {
+  Matrix hilbert(10, 10);
+  for (int i = 0; i < 10; i++)
+    for (int j = 0; j < 10; j++) hilbert(i, j) = 1.0 / (i + j + 1);
+  Matrix b = FillMatrix(10, 1, 19);
+  MixedPrecisionSolver solver(hilbert);
+  RefinementStats stats;
+  Matrix x = solver.Solve(b, &stats);
+  EXPECT_TRUE(stats.fell_back);
+  EXPECT_TRUE(solver.UsesFallback());
+  EXPECT_TRUE(x == LUFactorization(hilbert).Solve(b));
+  EXPECT_ANY_THROW(solver.SetMaxIterations(0));
+  EXPECT_ANY_THROW(solver.Solve(Matrix(3, 1)));
+}
+
+TEST(async, operationGraph) {
+  Matrix a = FillMatrix(30, 30, 20) + 30 * Identity(30);
+  Matrix b = FillMatrix(30, 30, 21);
+  AsyncResult<Matrix> product = MulMatrixAsync(a, b);
+  AsyncResult<Matrix> sum = SumMatrixAsync(product, MulNumberAsync(b, 2));
+  AsyncResult<Matrix> difference = SubMatrixAsync(sum, b);
+  AsyncResult<Matrix> inverse = InverseAsync(a);
+  AsyncResult<Matrix> solution = SolveAsync(a, difference);
+  AsyncResult<double> determinant = DeterminantAsync(TransposeAsync(a));
+  AsyncResult<int> rows =
+      solution.Then([](const Matrix& x) { return x.GetRows(); });
+  Matrix expected = a * b + b;
+  EXPECT_TRUE(difference.Get() == expected);
+  EXPECT_TRUE(a * solution.Get() == expected);
+  EXPECT_TRUE(a * inverse.Get() == Identity(30));
+  EXPECT_NEAR(determinant.Get() / a.Determinant(), 1, 1e-12);
+  EXPECT_EQ(rows.Get(), 30);
+  EXPECT_TRUE(rows.IsReady());
+}
+
+TEST(async, errorsAndCancellation) {
+  ThreadPool pool(2);
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  AsyncResult<Matrix> slow = RunAsync(pool, [opened] {
+    opened.wait();
+    return Identity(3);
+  });
+  AsyncResult<Matrix> cancelled = TransposeAsync(slow);
+  AsyncResult<Matrix> dependent = MulNumberAsync(cancelled, 2);
+  cancelled.Cancel();
+  gate.set_value();
+  EXPECT_TRUE(slow.Get() == Identity(3));
+  EXPECT_THROW(cancelled.Get(), OperationCancelled);
+  EXPECT_THROW(dependent.Get(), OperationCancelled);
+  EXPECT_THROW(MulMatrixAsync(Matrix(2, 3), Matrix(2, 3)).Get(),
+               std::invalid_argument);
+  EXPECT_ANY_THROW(ThreadPool broken(0));
+}
+
+TEST(async, loneTaskStillSplitsItsRows) {
+  int thread_count = parallel::ThreadCount();
+  std::size_t threshold = parallel::SerialThreshold();
+  parallel::SetThreadCount(4);
+  parallel::SetSerialThreshold(1);
+  std::promise<std::size_t> threads;
+  ThreadPool::Default().Submit([&threads] {
+    std::mutex mutex;
+    std::set<std::thread::id> ids;
+    parallel::For(4, 1000, [&](int, int) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      std::lock_guard<std::mutex> lock(mutex);
+      ids.insert(std::this_thread::get_id());
+    });
+    threads.set_value(ids.size());
+  });
+  EXPECT_GT(threads.get_future().get(), 1u);
+  Matrix a = FillMatrix(120, 120, 44), b = FillMatrix(120, 120, 45);
+  EXPECT_TRUE(MulMatrixAsync(a, b).Get() == Matrix(a * b));
+  parallel::SetSerialThreshold(threshold);
+  parallel::SetThreadCount(thread_count);
+}
+
+TEST(lowRankUpdate, matchesRecomputation) {
+  Matrix a = FillMatrix(40, 40, 22) + 10 * Identity(40);
+  Matrix row = FillMatrix(1, 40, 23), col = FillMatrix(40, 1, 24);
+  Matrix u = FillMatrix(40, 3, 25), v = FillMatrix(40, 3, 26);
+  IncrementalInverse incremental(a);
+  incremental.UpdateRow(3, row);
+  incremental.UpdateColumn(7, col);
+  incremental.Update(u, v);
+  Matrix expected = a + u * v.Transpose();
+  for (int j = 0; j < 40; j++) expected(3, j) += row(0, j);
+  for (int i = 0; i < 40; i++) expected(i, 7) += col(i, 0);
+  EXPECT_TRUE(incremental.GetMatrix() == expected);
+  EXPECT_TRUE(incremental.GetInverse() == expected.InverseMatrix());
+  EXPECT_NEAR(incremental.Determinant() / expected.Determinant(), 1, 1e-9);
+  EXPECT_EQ(incremental.GetRefactorizations(), 0);
+}
+
+TEST(lowRankUpdate, breakdownRefactorizes) {
+  IncrementalInverse incremental(Identity(3));
+  Matrix delta(1, 3);
+  delta(0, 0) = -1 + 1e-10;
+  incremental.UpdateRow(0, delta);
+  EXPECT_EQ(incremental.GetRefactorizations(), 1);
+  double pivot = incremental.GetMatrix()(0, 0);
+  EXPECT_DOUBLE_EQ(incremental.Determinant(), pivot);
+  EXPECT_DOUBLE_EQ(incremental.GetInverse()(0, 0), 1 / pivot);
+  Matrix singular(1, 3);
+  singular(0, 0) = -pivot;
+  EXPECT_ANY_THROW(incremental.UpdateRow(0, singular));
+  EXPECT_DOUBLE_EQ(incremental.Determinant(), pivot);
+  EXPECT_ANY_THROW(incremental.UpdateRow(3, delta));
+  EXPECT_ANY_THROW(incremental.Update(Matrix(3, 1), Matrix(3, 2)));
+  EXPECT_ANY_THROW(incremental.SetMaxGrowth(0.5));
+}
+
+TEST(profiler, aggregatesByOperationAndShape) {
+  Profiler& profiler = Profiler::Instance();
+  profiler.Reset();
+  Matrix a = FillMatrix(20, 30, 27), b = FillMatrix(30, 5, 28);
+  a.MulMatrix(b);
+  EXPECT_TRUE(profiler.GetEntries().empty());
+  profiler.Enable();
+  Matrix c = FillMatrix(20, 30, 27), d = FillMatrix(17, 30, 29);
+  c.MulMatrix(b);
+  d.MulMatrix(b);
+  c.Transpose();
+  profiler.Disable();
+  c.Transpose();
+  bool found = false;
+  for (const Profiler::Entry& entry : profiler.GetEntries()) {
+    if (entry.operation != "MulMatrix") continue;
+    found = true;
+    EXPECT_EQ(entry.rows_bucket, 32);
+    EXPECT_EQ(entry.cols_bucket, 8);
+    EXPECT_EQ(entry.calls, 2);
+    EXPECT_GE(entry.seconds, 0);
+    if (!profiler.CountersAvailable()) {
+      EXPECT_EQ(entry.counters[Profiler::kCycles], -1);
+    }
+    EXPECT_EQ(entry.counters[Profiler::kVectorInstructions], -1);
+  }
+  EXPECT_TRUE(found);
+  std::string json = profiler.ExportJson();
+  EXPECT_NE(json.find("\"operation\": \"MulMatrix\", \"rows\": 32"),
+            std::string::npos);
+  EXPECT_NE(json.find("\"operation\": \"Transpose\""), std::string::npos);
+  std::string csv = profiler.ExportCsv();
+  EXPECT_EQ(csv.find("operation,rows,cols,calls,seconds,cycles"), 0u);
+  EXPECT_NE(csv.find("\nMulMatrix,32,8,2,"), std::string::npos);
+  profiler.Reset();
+  EXPECT_TRUE(profiler.GetEntries().empty());
+  profiler.Enable();
+  { ProfileScope huge("Huge", (1 << 30) + 1, 1); }
+  profiler.Disable();
+  ASSERT_EQ(profiler.GetEntries().size(), 1u);
+  EXPECT_EQ(profiler.GetEntries()[0].rows_bucket,
+            std::numeric_limits<int>::max());
+  EXPECT_EQ(profiler.GetEntries()[0].cols_bucket, 1);
+  profiler.Reset();
+  EXPECT_EQ(profiler.ExportJson(), "[]\n");
+}
+
+TEST(allocation, mappedStorage) {
+  std::size_t threshold = allocation::LargeThreshold();
+  allocation::Placement placement = allocation::GetPlacement();
+  allocation::SetLargeThreshold(0);
+  EXPECT_EQ(placement, allocation::Placement::kLazy);
+  for (allocation::Placement mode :
+       {allocation::Placement::kLazy, allocation::Placement::kInterleave}) {
+    allocation::SetPlacement(mode);
+    Matrix a(600, 700);
+    EXPECT_EQ(a(599, 699), 0);
+    EXPECT_EQ(a(123, 456), 0);
+    a(599, 699) = 2;
+    Matrix b(a);
+    Matrix c(std::move(a));
+    EXPECT_TRUE(b == c);
+    b.SetRows(3);
+    b.SetCols(1);
+    EXPECT_EQ(b(2, 0), 0);
+    c = b;
+    EXPECT_EQ(c.GetRows(), 3);
+  }
+  bool mapped = false;
+  double* data = allocation::Allocate(0, 5, &mapped);
+  EXPECT_EQ(data, nullptr);
+  allocation::Release(data, 0, 5, mapped);
+  allocation::SetLargeThreshold(threshold);
+  allocation::SetPlacement(placement);
+}
+
+TEST(structured, triangular) {
+  Matrix dense = FillMatrix(70, 70, 30) + 5 * Identity(70);
+  Matrix b = FillMatrix(70, 3, 31);
+  for (TriangularMatrix::Triangle triangle :
+       {TriangularMatrix::kLower, TriangularMatrix::kUpper}) {
+    TriangularMatrix t(dense, triangle);
+    Matrix full = t;
+    EXPECT_NEAR(t.Determinant() / full.Determinant(), 1, 1e-9);
+    EXPECT_TRUE(full * t.Solve(b) == b);
+    EXPECT_TRUE(t * b == full * b);
+    EXPECT_TRUE(b.Transpose() * t == b.Transpose() * full);
+    EXPECT_TRUE(t + dense == full + dense);
+  }
+  TriangularMatrix lower(3, TriangularMatrix::kLower);
+  lower(2, 0) = 4;
+  EXPECT_EQ(lower(2, 0), 4);
+  EXPECT_ANY_THROW(lower(0, 2) = 1);
+  EXPECT_EQ(static_cast<const TriangularMatrix&>(lower)(0, 2), 0);
+  EXPECT_ANY_THROW(lower.Solve(Matrix(3, 1)));
+}
+
+TEST(structured, symmetric) {
+  Matrix a = FillMatrix(90, 40, 32);
+  SymmetricMatrix gram = SymmetricMatrix::Gram(a);
+  Matrix full = gram;
+  EXPECT_TRUE(full == a.Transpose() * a);
+  EXPECT_EQ(gram(3, 7), gram(7, 3));
+  Matrix b = FillMatrix(40, 2, 33);
+  EXPECT_TRUE(gram * b == full * b);
+  EXPECT_TRUE(b.Transpose() * gram == b.Transpose() * full);
+  EXPECT_TRUE(full * gram.Solve(b) == b);
+  EXPECT_NEAR(gram.Determinant() / full.Determinant(), 1, 1e-9);
+  SymmetricMatrix indefinite(2);
+  indefinite(0, 1) = 1;
+  EXPECT_DOUBLE_EQ(indefinite.Determinant(), -1);
+  Matrix swap_rows(2, 1);
+  swap_rows(0, 0) = 3;
+  swap_rows(1, 0) = 4;
+  EXPECT_TRUE(indefinite.Solve(swap_rows)(0, 0) == 4);
+  EXPECT_TRUE(SymmetricMatrix(full).ToMatrix() == full);
+  // Indefinite matrices take the packed Bunch-Kaufman path, including 2x2
+  // pivots for the zero diagonal entries
+  Matrix m = FillMatrix(60, 60, 47);
+  Matrix mixed = m + m.Transpose();
+  for (int i = 0; i < 60; i += 3) mixed(i, i) = 0;
+  SymmetricMatrix symmetric(mixed);
+  Matrix c = FillMatrix(60, 3, 48);
+  EXPECT_TRUE(mixed * symmetric.Solve(c) == c);
+  EXPECT_NEAR(symmetric.Determinant() / mixed.Determinant(), 1, 1e-9);
+  SymmetricMatrix singular(3);
+  singular(0, 0) = singular(1, 1) = 1;
+  EXPECT_EQ(singular.Determinant(), 0);
+  EXPECT_ANY_THROW(singular.Solve(Matrix(3, 1)));
+}
+
+TEST(structured, diagonal) {
+  DiagonalMatrix d(std::vector<double>{2, -4, 0.5});
+  Matrix b = FillMatrix(3, 4, 34);
+  Matrix full = d;
+  EXPECT_DOUBLE_EQ(d.Determinant(), -4);
+  EXPECT_TRUE(d * b == full * b);
+  EXPECT_TRUE(b.Transpose() * d == b.Transpose() * full);
+  EXPECT_TRUE(full * d.Solve(b) == b);
+  EXPECT_TRUE(d.Inverse() * full == Identity(3));
+  EXPECT_ANY_THROW(d(0, 1) = 1);
+  EXPECT_ANY_THROW(DiagonalMatrix(2).Inverse());
+}
+
+TEST(structured, band) {
+  Matrix dense = FillMatrix(200, 200, 35);
+  BandMatrix band(dense, 3, 2);
+  Matrix full = band;
+  EXPECT_EQ(full(10, 6), 0);
+  EXPECT_EQ(full(10, 7), dense(10, 7));
+  EXPECT_EQ(full(10, 12), dense(10, 12));
+  EXPECT_EQ(full(10, 13), 0);
+  Matrix b = FillMatrix(200, 2, 36);
+  EXPECT_TRUE(full * band.Solve(b) == b);
+  EXPECT_TRUE(band * b == full * b);
+  Matrix c = FillMatrix(3, 200, 38);
+  EXPECT_TRUE(c * band == c * full);
+  BandMatrix small(FillMatrix(8, 8, 37), 2, 1);
+  EXPECT_NEAR(small.Determinant() / Matrix(small).Determinant(), 1, 1e-9);
+  EXPECT_ANY_THROW(band(10, 13) = 1);
+  EXPECT_EQ(BandMatrix(4, 1, 1).Determinant(), 0);
+  EXPECT_ANY_THROW(BandMatrix(4, 1, 1).Solve(Matrix(4, 1)));
+  EXPECT_ANY_THROW(BandMatrix(4, -1, 1));
+}
+
+TEST(structured, productsOfStructuredMatrices) {
+  Matrix m = FillMatrix(40, 40, 46);
+  TriangularMatrix lower(m, TriangularMatrix::kLower);
+  TriangularMatrix upper(m.Transpose(), TriangularMatrix::kUpper);
+  SymmetricMatrix symmetric(m);
+  DiagonalMatrix diagonal(40);
+  for (int i = 0; i < 40; i++) diagonal(i, i) = i - 20.5;
+  BandMatrix band(m, 2, 3);
+  Matrix l = lower, u = upper, s = symmetric, d = diagonal, b = band;
+  Matrix lower_squared = lower * lower;
+  EXPECT_TRUE(lower_squared == l * l);
+  EXPECT_EQ(lower_squared(3, 30), 0);
+  EXPECT_TRUE(lower * upper == l * u);
+  EXPECT_TRUE(upper * lower == u * l);
+  DiagonalMatrix diagonal_squared = diagonal * diagonal;
+  EXPECT_EQ(diagonal_squared(3, 3), 17.5 * 17.5);
+  EXPECT_TRUE(diagonal * lower == d * l);
+  EXPECT_TRUE(upper * diagonal == u * d);
+  EXPECT_TRUE(symmetric * band == s * b);
+  EXPECT_TRUE(band * symmetric == b * s);
+  EXPECT_TRUE(diagonal * band == d * b);
+  EXPECT_TRUE(symmetric * symmetric == s * s);
+  EXPECT_TRUE(band * band == b * b);
+  EXPECT_ANY_THROW(lower * TriangularMatrix(3, TriangularMatrix::kLower));
+}
+
+TEST(structured, bandWithUnderflowingDeterminant) {
+  BandMatrix band(400, 1, 1);
+  for (int i = 0; i < 400; i++) {
+    band(i, i) = 0.1;
+    if (i > 0) band(i, i - 1) = 0.01;
+    if (i < 399) band(i, i + 1) = -0.01;
+  }
+  // About 1e-400 underflows, yet the matrix is well conditioned
+  EXPECT_EQ(band.Determinant(), 0);
+  Matrix b = FillMatrix(400, 1, 42);
+  Matrix x = band.Solve(b);
+  EXPECT_TRUE(band * x == b);
+}
+
+TEST(power, binaryExponentiation) {
+  Matrix fibonacci(2, 2);
+  fibonacci(0, 0) = fibonacci(0, 1) = fibonacci(1, 0) = 1;
+  Matrix result = fibonacci.Power(40);
+  EXPECT_EQ(result(0, 0), 165580141);
+  EXPECT_EQ(result(0, 1), 102334155);
+  EXPECT_TRUE(fibonacci.Power(0) == Identity(2));
+  EXPECT_TRUE(fibonacci.Power(1) == fibonacci);
+  Matrix a = FillMatrix(30, 30, 38) * 0.2;
+  Matrix expected = a;
+  for (int i = 1; i < 13; i++) expected *= a;
+  EXPECT_TRUE(a.Power(13) == expected);
+  Matrix inverse = a.InverseMatrix();
+  EXPECT_TRUE(a.Power(-2) == inverse * inverse);
+  EXPECT_ANY_THROW(Matrix(2, 3).Power(2));
+}
+
+TEST(power, symmetricDiagonalization) {
+  // Symmetric doubly stochastic matrix, whose powers converge to 1/n
+  Matrix walk(4, 4);
+  for (int i = 0; i < 4; i++) {
+    walk(i, i) = 0.5;
+    walk(i, (i + 1) % 4) += 0.25;
+    walk(i, (i + 3) % 4) += 0.25;
+  }
+  Matrix limit = walk.Power(1000000);
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++) EXPECT_NEAR(limit(i, j), 0.25, 1e-12);
+  // Q * diag(lambda) * Q^T with a random orthogonal Q and known eigenvalues
+  Matrix m = FillMatrix(12, 12, 39);
+  Matrix q = m * QRFactorization(m).GetR().InverseMatrix();
+  DiagonalMatrix lambda(12), lambda_power(12);
+  long long power = (1LL << 25) + 1;
+  for (int i = 0; i < 12; i++) {
+    lambda(i, i) = i == 0 ? 1 : i == 1 ? -1 : 1 - 1.0 / (1 << (i + 10));
+    lambda_power(i, i) = std::pow(lambda(i, i), static_cast<double>(power));
+  }
+  Matrix s = q * lambda * q.Transpose();
+  s = 0.5 * (s + s.Transpose());
+  Matrix expected = q * lambda_power * q.Transpose();
+  Matrix result = s.Power(power);
+  for (int i = 0; i < 12; i++)
+    for (int j = 0; j < 12; j++) EXPECT_NEAR(result(i, j), expected(i, j), 1e-6);
+}
+
+TEST(power, keepsParityOfHugeExponents) {
+  Matrix d(2, 2);
+  d(0, 0) = -1;
+  d(1, 1) = 0.5;
+  Matrix odd = d.Power((1LL << 60) + 1);
+  EXPECT_NEAR(odd(0, 0), -1, 1e-9);
+  EXPECT_EQ(odd(1, 1), 0);
+  EXPECT_NEAR(d.Power(1LL << 60)(0, 0), 1, 1e-9);
+}
+
+TEST(exponential, padeScalingAndSquaring) {
+  EXPECT_TRUE(Matrix(3, 3).Exp() == Identity(3));
+  Matrix diagonal(2, 2);
+  diagonal(0, 0) = 3;
+  diagonal(1, 1) = -1;
+  Matrix exp_diagonal = diagonal.Exp();
+  EXPECT_NEAR(exp_diagonal(0, 0), std::exp(3.0), 1e-12);
+  EXPECT_NEAR(exp_diagonal(1, 1), std::exp(-1.0), 1e-15);
+  EXPECT_NEAR(exp_diagonal(0, 1), 0, 1e-15);
+  Matrix rotation(2, 2);
+  rotation(0, 1) = 2.5;
+  rotation(1, 0) = -2.5;
+  Matrix turned = rotation.Exp();
+  EXPECT_NEAR(turned(0, 0), std::cos(2.5), 1e-14);
+  EXPECT_NEAR(turned(0, 1), std::sin(2.5), 1e-14);
+  Matrix a = FillMatrix(20, 20, 40) * 3;
+  EXPECT_TRUE(a.Exp() * (-1 * a).Exp() == Identity(20));
+  EXPECT_ANY_THROW(Matrix(2, 3).Exp());
+}
+
+TEST(textIO, parseCsvAndWhitespace) {
+  Matrix csv = ParseMatrix("1,2.5, -3\r\n\n4e2 ,+5,6\n");
+  EXPECT_EQ(csv.GetRows(), 2);
+  EXPECT_EQ(csv.GetCols(), 3);
+  EXPECT_EQ(csv(0, 1), 2.5);
+  EXPECT_EQ(csv(0, 2), -3);
+  EXPECT_EQ(csv(1, 0), 400);
+  EXPECT_EQ(csv(1, 1), 5);
+  Matrix spaces = ParseMatrix("  1\t2 3\n4 5   6");
+  EXPECT_EQ(spaces.GetRows(), 2);
+  EXPECT_EQ(spaces.GetCols(), 3);
+  for (int i = 0; i < 6; i++) EXPECT_EQ(spaces(i / 3, i % 3), i + 1);
+  EXPECT_EQ(ParseMatrix("\n \n").GetRows(), 0);
+  EXPECT_ANY_THROW(ParseMatrix("1 2 3\n4 5"));
+  EXPECT_ANY_THROW(ParseMatrix("1,2\n3,,4"));
+  EXPECT_ANY_THROW(ParseMatrix("1 2x"));
+  Matrix extreme = ParseMatrix("1e400 -1e400 1e-400 -1e-400 5");
+  EXPECT_EQ(extreme(0, 0), HUGE_VAL);
+  EXPECT_EQ(extreme(0, 1), -HUGE_VAL);
+  EXPECT_EQ(extreme(0, 2), 0);
+  EXPECT_TRUE(std::signbit(extreme(0, 3)));
+  EXPECT_EQ(extreme(0, 4), 5);
+  EXPECT_ANY_THROW(ParseMatrix("1 +-5"));
+  EXPECT_ANY_THROW(ParseMatrix("++1"));
+  EXPECT_ANY_THROW(ParseMatrix("1;2", ','));
+  EXPECT_ANY_THROW(ReadMatrix("/nonexistent/matrix.txt"));
+}
+
+TEST(textIO, roundTripIsExact) {
+  std::size_t threshold = parallel::SerialThreshold();
+  parallel::SetSerialThreshold(1);
+  Matrix m = FillMatrix(300, 17, 41);
+  m(0, 0) = 0.1;
+  m(0, 1) = 1e-300;
+  m(0, 2) = -1.7976931348623157e308;
+  for (char delimiter : {' ', ','}) {
+    Matrix back = ParseMatrix(FormatMatrix(m, delimiter));
+    ASSERT_EQ(back.GetRows(), 300);
+    ASSERT_EQ(back.GetCols(), 17);
+    for (int i = 0; i < 300; i++)
+      for (int j = 0; j < 17; j++) ASSERT_EQ(back(i, j), m(i, j));
+  }
+  EXPECT_EQ(FormatMatrix(ParseMatrix("0.1,2")), "0.1 2\n");
+  // Each row is longer than a formatting block, so blocks hold single rows
+  Matrix wide = FillMatrix(3, 200000, 43);
+  Matrix wide_back = ParseMatrix(FormatMatrix(wide));
+  for (int j = 0; j < 200000; j++) ASSERT_EQ(wide_back(2, j), wide(2, j));
+  std::string path = testing::TempDir() + "matrix_io_test.csv";
+  WriteMatrix(m, path, ',');
+  Matrix read = ReadMatrix(path);
+  std::remove(path.c_str());
+  for (int i = 0; i < 300; i++)
+    for (int j = 0; j < 17; j++) ASSERT_EQ(read(i, j), m(i, j));
+  std::stringstream stream;
+  stream << m;
+  Matrix streamed;
+  stream >> streamed;
+  EXPECT_TRUE(streamed == m);
+  parallel::SetSerialThreshold(threshold);
+}
+
 int main(int argc, char *argv[]) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();